@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <array>
 #include <vector>
 #include <cstdint>  // for uint32_t
@@ -7,42 +8,25 @@
 #include <fstream>
 #include <sstream>
 #include <queue>
+#include <deque>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
 #include <climits>  // For INT_MAX
 #include <limits>   // For UINT_MAX and other limits
+#include <unistd.h>  // For ftruncate
 using namespace std;
 
 // Some global variables
 constexpr int pageTableSize = 64;  // Max size of each page table = 64
-int currVmaNum;  // Recore the # of VMAs of the current process
-int occupiedFrame = 0;  // Number of frames used
-bool segv;  // Whether there's a segv error
-int numFrames = 0;  // Number of frames
-int idx = 0;
-int randNumCnt = 0;  // To load random numbers
-vector<int> randvals;  // To load random numbers
-int ofs = 0;  // To get the random number
-bool workingSet = false;  // Whether the pager is working-set
-// -oOPFS & variables
-bool O_flag = false;
-bool P_flag = false;
-bool F_flag = false;
-bool S_flag = false;
-// For the final summary (S flag)
-long inst_count = 0;
-long ctx_switches = 0;  
-long process_exits = 0;
-long totalMaps = 0;
-long totalUnmaps = 0;
-long totalIns = 0;
-long totalOuts = 0;
-long totalFins = 0;
-long totalFouts = 0;
-long totalZeros = 0;
-long totalSegv = 0;
-long totalSegprot = 0;
-long totalRead = 0;
-long totalWrite = 0;
-long totalExit = 0;
+constexpr int maxFrames = 128;  // Frame numbers must fit in Pte_t::FRAMENUMBER (7 bits)
+constexpr int maxCpus = 64;  // CPU ids of multi-CPU traces
+constexpr int histBuckets = 32;  // Buckets of the log2 histograms: bucket b counts the values in [2^b, 2^(b+1))
 
 // PTE strucutre (32 bits)
 struct Pte_t{
@@ -55,7 +39,10 @@ struct Pte_t{
     uint32_t FRAMENUMBER: 7;
     uint32_t VALID_VMA: 1;  // Whether the page is part of one of the VMAs
     uint32_t PRE_REFERENCED: 1;  // Since the REFERENCED bit will be reset for working-set pager every time, use this bit the record its previous referenced state to print out the final summary correctly
-    // uint32_t REMAIN: 20;  // REMAIN occupies 20 bits of space in the structure: TBA
+    uint32_t HUGE_ORDER: 3;  // The page is mapped as part of a superpage of 1 << HUGE_ORDER pages (0: base page)
+    uint32_t ZSWAPPED: 1;  // The evicted page is held in the compressed pool (--zswap)
+    uint32_t COW: 1;  // The page shares its frame since a fork: the first write takes a private copy
+    // uint32_t REMAIN: 17;  // REMAIN occupies 17 bits of space in the structure: TBA
     // constructor
     Pte_t() {
         PRESENT = 0;
@@ -67,6 +54,9 @@ struct Pte_t{
         FRAMENUMBER = 0;
         VALID_VMA = 0;
         PRE_REFERENCED = 0;
+        HUGE_ORDER = 0;
+        ZSWAPPED = 0;
+        COW = 0;
     }
 };
 
@@ -80,6 +70,43 @@ struct pstats {
     long zeros = 0;
     long segv = 0;
     long segprot = 0;
+    // TLB (only counted with --tlb)
+    long tlbHits = 0;
+    long tlbMisses = 0;
+    long tlbShootdowns = 0;
+    // Superpages (only counted when a VMA asks for them)
+    long hugeMaps = 0;  // Superpages mapped
+    long hugeFrag = 0;  // Base pages of unmapped superpages that were never referenced (internal fragmentation)
+    // Readahead (only counted with --readahead)
+    long raIssued = 0;  // Pages prefetched
+    long raHits = 0;  // Prefetched pages referenced while resident
+    long raWasted = 0;  // Prefetched pages unmapped without being referenced
+    // Multi-CPU traces
+    long remoteShootdowns = 0;  // Unmaps that interrupted another CPU running the process
+    // Background writeback (only counted with --writeback), the synchronous writebacks are the OUTs and FOUTs
+    long bgWritebacks = 0;  // Dirty pages cleaned by the writeback daemon
+    long redirtied = 0;  // Cleaned pages written again before they were unmapped
+    // Compressed swap pool (only counted with --zswap)
+    long zouts = 0;  // Evicted pages compressed into the pool instead of written to swap
+    long zins = 0;  // Faulted pages decompressed from the pool instead of read from swap
+    long zswapWritebacks = 0;  // Pages pushed out of the full pool to swap (counted in the OUTs as well)
+    // Fork and copy-on-write (only counted in traces that fork)
+    long forks = 0;
+    long cowFaults = 0;  // Writes to copy-on-write pages
+    long cowCopies = 0;  // Of which had to copy a frame still shared with other pages
+    // NUMA (only counted with --numa)
+    long localAccesses = 0;  // r/w to a frame on the process's home node
+    long remoteAccesses = 0;  // r/w to a frame on another node
+    long migrations = 0;  // Pages moved to the home node
+    // Load control (only counted with --load-control)
+    long suspensions = 0;  // Times the process was swapped out as a whole
+    long suspendedTime = 0;  // Instructions run by the other processes while it was suspended
+    long deferred = 0;  // Instructions of the process held back until it was resumed
+    // Metrics (only counted with --metrics)
+    long refs = 0;  // r/w to valid pages
+    long faults = 0;
+    long reuseHist[histBuckets] = {};  // Instructions since the previous r/w of the same page
+    long faultGapHist[histBuckets] = {};  // Instructions since the previous fault of the process
 };
 
 class Vma {
@@ -89,42 +116,183 @@ class Vma {
         int vpageNum = 0;
         bool writeProtected = false;
         bool fileMapped = false;
-        // Constructor
-        Vma(int start_vpage, int end_vpage, bool write_protected, bool file_mapped):
-        startVpage(start_vpage), endVpage(end_vpage), vpageNum(endVpage - startVpage + 1), writeProtected(write_protected), fileMapped(file_mapped) {}
+        int pageOrder = 0;  // Pages of the VMA are mapped in superpages of 1 << pageOrder pages (optional 5th column)
+        // Constructors
+        Vma() {}
+        Vma(int start_vpage, int end_vpage, bool write_protected, bool file_mapped, int page_order = 0):
+        startVpage(start_vpage), endVpage(end_vpage), vpageNum(endVpage - startVpage + 1), writeProtected(write_protected), fileMapped(file_mapped), pageOrder(page_order) {}
 };
 
-// Process class: TBA
+// Process class: a process of the simulation. Its VMAs, page table and stats live in the arenas of the
+// simulation, which hold those of all processes contiguously; the process itself is found by its id.
 class Process {
     public:
-        int processId;
+        int processId = 0;
+        int vmaStart = 0;  // First VMA of the process in the VMA arena
         int vmaNum = 0;
-        vector<Vma> vmaTable;
-        Pte_t pageTable[pageTableSize];  // The process's page table:
+        Pte_t* pageTable = nullptr;  // The process's page table: pageTableSize entries of the page-table arena
         bool exit = false;  // Whether the process is about to complete (exit)
-        pstats* stats;
-        // Constructor
-        Process(int id, int vma_num): processId(id), vmaNum(vma_num) {
-            stats = new pstats;  // Initialize the pstats struct in process
-        }
-};
-vector<Process*> processTable;  // Stores pointers to all processes
-Process* currProc;  // Process Id of the current process switched to (current_process)
-Pte_t* currPageTable;  // Page table of the current process
-
-// frame structure: TBA
-struct Frame_t {
-    int f_id;  // The id of this frame
-    bool inUse = false;  // If the frame is currently in use
-    Process* process;  // ID of the process that owns the frame, -1 if unused
-    int vPage = -1;  // Virtual page number mapped to this frame, -1 if unused
-    unsigned int age;  // For the aging pager
-    int time_last_used;   // For the working-set pager
-    bool canReplace = false;  // Whether the frame can be replaced for working-set pager
-    Frame_t(int id): f_id(id) {}
-};
-vector<Frame_t> frameTable;  // The frame table that stores all frames
-deque<Frame_t*> freeFrames;  // The deque to manage all free frames
+        pstats* stats = nullptr;  // In the stats arena
+};
+// Key identifying a virtual page across processes (for pagers that remember non-resident pages)
+inline int page_key(int pid, int vpage) { return pid * pageTableSize + vpage; }
+
+// Frame-indexed bitset (one bit per frame, 64 frames per word)
+struct FrameBitset {
+    vector<uint64_t> words;
+    void resize(int frameNum) { words.resize((frameNum + 63) / 64, 0); }  // New frames start cleared
+    void clear() { memset(words.data(), 0, words.size() * sizeof(uint64_t)); }
+    bool test(int f) const { return (words[f >> 6] >> (f & 63)) & 1; }
+    void set(int f) { words[f >> 6] |= 1ULL << (f & 63); }
+    int count() const {
+        int n = 0;
+        for (uint64_t word: words) { n += __builtin_popcountll(word); }
+        return n;
+    }
+    void reset(int f) { words[f >> 6] &= ~(1ULL << (f & 63)); }
+    // Return the first set bit in [from, to), or -1 if there is none
+    int find_next(int from, int to) const {
+        while (from < to) {
+            uint64_t word = words[from >> 6] >> (from & 63);
+            if (word) {
+                int f = from + __builtin_ctzll(word);
+                return f < to ? f : -1;
+            }
+            from = (from | 63) + 1;  // Start of the next word
+        }
+        return -1;
+    }
+};
+
+
+// Flags packed into FrameTable::bits (one byte per frame)
+constexpr uint8_t FRAME_IN_USE = 0x1;  // The frame is currently in use
+constexpr uint8_t FRAME_PRE_REFERENCED = 0x2;  // Mirror of the mapped PTE's PRE_REFERENCED bit (working-set pager)
+
+// Frame table stored as parallel arrays (struct-of-arrays): frame i is described by the i-th entry of every array.
+// pid/vPage are the reverse map (frame -> page). R/M bits of mapped pages are mirrored here as frame-indexed
+// bitsets, so the pagers scan contiguous memory a word (64 frames) at a time instead of dereferencing
+// process->pageTable[vPage] for every frame, and clearing every R bit is a memset.
+struct FrameTable {
+    vector<int> pid;  // ID of the process that owns the frame, -1 if unused
+    vector<int> vPage;  // Virtual page number mapped to this frame, -1 if unused
+    vector<unsigned int> age;  // For the aging pager
+    vector<int> time_last_used;  // For the working-set pager
+    vector<uint8_t> bits;  // FRAME_* flags
+    vector<uint8_t> order;  // Page-size order of the mapping: a superpage spans the aligned block of 1 << order frames
+    FrameBitset referencedBits;  // Mirror of the mapped PTEs' REFERENCED bits
+    FrameBitset modifiedBits;  // Mirror of the mapped PTEs' MODIFIED bits
+
+    int size() const { return (int)bits.size(); }
+    bool inUse(int f) const { return bits[f] & FRAME_IN_USE; }
+    bool referenced(int f) const { return referencedBits.test(f); }
+    bool modified(int f) const { return modifiedBits.test(f); }
+    void add_frame() {
+        pid.push_back(-1);
+        vPage.push_back(-1);
+        age.push_back(0);
+        time_last_used.push_back(0);
+        bits.push_back(0);
+        order.push_back(0);
+        referencedBits.resize(size());
+        modifiedBits.resize(size());
+    }
+};
+// Intrusive doubly-linked lists over a range of ids (frame ids or page keys), an id is in at most one list at a time.
+// A list runs from its front (least recent) to its back (most recent).
+struct IdList {
+    int front = -1;
+    int back = -1;
+    int size = 0;
+};
+struct IdLinks {
+    vector<int> prev, next;
+    void resize(int idNum) {
+        prev.resize(idNum, -1);
+        next.resize(idNum, -1);
+    }
+    void push_back(IdList& list, int id) {
+        prev[id] = list.back;
+        next[id] = -1;
+        if (list.back != -1) { next[list.back] = id; } else { list.front = id; }
+        list.back = id;
+        list.size++;
+    }
+    void remove(IdList& list, int id) {
+        if (prev[id] != -1) { next[prev[id]] = next[id]; } else { list.front = next[id]; }
+        if (next[id] != -1) { prev[next[id]] = prev[id]; } else { list.back = prev[id]; }
+        list.size--;
+    }
+    int pop_front(IdList& list) {
+        int id = list.front;
+        remove(list, id);
+        return id;
+    }
+};
+
+// Checkpoints (--checkpoint): the state of a simulation is written as raw values in a fixed order, vectors and
+// deques prefixed with their length. A snapshot is only restored by a simulation of the same trace and options
+// (checked against the header), so no layout information is stored.
+class SnapshotWriter {
+    private:
+        FILE* file;
+    public:
+        explicit SnapshotWriter(FILE* file): file(file) {}
+        template <typename T> void put(const T& value) { fwrite(&value, sizeof(T), 1, file); }
+        template <typename T> void put(const vector<T>& values) {
+            put(values.size());
+            fwrite(values.data(), sizeof(T), values.size(), file);
+        }
+        void put(const vector<bool>& values) {
+            put(values.size());
+            for (bool value: values) { put(value); }
+        }
+        void put(const deque<int>& values) {
+            put(values.size());
+            for (int value: values) { put(value); }
+        }
+        void put(const FrameBitset& bits) { put(bits.words); }
+        void put(const IdLinks& links) {
+            put(links.prev);
+            put(links.next);
+        }
+};
+class SnapshotReader {
+    private:
+        FILE* file;
+        bool ok = true;  // Every read so far succeeded
+        size_t get_size() {
+            size_t n = 0;
+            get(n);
+            if (n > (1u << 30)) { ok = false; }  // A corrupt length
+            return ok ? n : 0;
+        }
+    public:
+        explicit SnapshotReader(FILE* file): file(file) {}
+        bool good() const { return ok; }
+        template <typename T> void get(T& value) { ok = ok && fread(&value, sizeof(T), 1, file) == 1; }
+        template <typename T> void get(vector<T>& values) {
+            values.resize(get_size());
+            ok = ok && fread(values.data(), sizeof(T), values.size(), file) == values.size();
+        }
+        void get(vector<bool>& values) {
+            values.resize(get_size());
+            for (size_t i = 0; i < values.size(); i++) {
+                bool value = false;
+                get(value);
+                values[i] = value;
+            }
+        }
+        void get(deque<int>& values) {
+            values.resize(get_size());
+            for (int& value: values) { get(value); }
+        }
+        void get(FrameBitset& bits) { get(bits.words); }
+        void get(IdLinks& links) {
+            get(links.prev);
+            get(links.next);
+        }
+};
 
 // Cost of each instruction
 struct InstrCost {
@@ -141,268 +309,468 @@ struct InstrCost {
     long exit = 1230;
     long read = 1;
     long write = 1;
+    long tlb_miss = 20;  // Page walk after a TLB miss
+    long tlb_shootdown = 60;  // Invalidating the TLB entry of an unmapped page
+    long ipi_shootdown = 1500;  // Interrupting another CPU that runs the process of an unmapped page
+    long bg_writeback = 250;  // Issuing a background writeback (the transfer itself overlaps execution)
+    long zouts = 900;  // Compressing a page into the pool
+    long zins = 500;  // Decompressing a page from the pool
+    long forks = 2000;
+    long cow_faults = 100;  // Write fault on a copy-on-write page
+    long cow_copies = 400;  // Copying the page to a private frame
+    long remote_access = 2;  // Extra cost of a r/w to a frame on another NUMA node
+    long migrations = 600;  // Copying a page to a frame on the home node
 };
 
-// Initialize frameTable and freeFrames
-void create_frames(int frameNum) {
-    for (int i = 0; i < frameNum; i++) {
-        Frame_t frame(i);
-        frameTable.push_back(frame);  // Add frame to the table
-    }
-    // Now, store pointers to the objects in frameTable in freeFrames
-    for (int i = 0; i < frameNum; i++) {
-        freeFrames.push_back(&frameTable[i]);  // Store address of frames in frameTable
-    }
+// The operations of the cost model, by the names used in cost files. The same fields also hold the count of each
+// operation in a run, which prices the run under any costs without simulating it again.
+struct CostField {
+    const char* name;
+    long InstrCost::* field;
+};
+const CostField costFields[] = {
+    {"maps", &InstrCost::maps}, {"unmaps", &InstrCost::unmaps}, {"ins", &InstrCost::ins}, {"outs", &InstrCost::outs},
+    {"fins", &InstrCost::fins}, {"fouts", &InstrCost::fouts}, {"zeros", &InstrCost::zeros}, {"segv", &InstrCost::segv},
+    {"segprot", &InstrCost::segprot}, {"ctx_switch", &InstrCost::ctx_switch}, {"exit", &InstrCost::exit},
+    {"read", &InstrCost::read}, {"write", &InstrCost::write}, {"tlb_miss", &InstrCost::tlb_miss},
+    {"tlb_shootdown", &InstrCost::tlb_shootdown}, {"ipi_shootdown", &InstrCost::ipi_shootdown},
+    {"bg_writeback", &InstrCost::bg_writeback}, {"zouts", &InstrCost::zouts}, {"zins", &InstrCost::zins},
+    {"forks", &InstrCost::forks}, {"cow_faults", &InstrCost::cow_faults}, {"cow_copies", &InstrCost::cow_copies},
+    {"remote_access", &InstrCost::remote_access}, {"migrations", &InstrCost::migrations}
+};
+
+// Operation counts start at zero
+InstrCost zero_counts() {
+    InstrCost counts;
+    for (const CostField& op: costFields) { counts.*op.field = 0; }
+    return counts;
+}
+// Total cost of the operation counts under the costs
+unsigned long long price(const InstrCost& counts, const InstrCost& costs) {
+    unsigned long long total = 0;
+    for (const CostField& op: costFields) { total += counts.*op.field * costs.*op.field; }
+    return total;
 }
 
-// Address exiting processes
-void exit_handler(Process* exitProc) {
-    cout << "EXIT current process " << exitProc->processId << endl;
-    // Unmap all mapped pages of the process from frames
-    for (int i = 0; i < pageTableSize; i++) {
-        exitProc->pageTable[i].PAGEDOUT = 0;  // First reset the PAGEDOUT of all pages of the exit process
-        if (exitProc->pageTable[i].PRESENT) {
-            exitProc->pageTable[i].PRESENT = 0;
-            if (O_flag) { cout << " UNMAP " << exitProc->processId << ":" << i << endl; }
-            // If pte is modified/ dirty (written to) and filemapped, need to write it back to its file (If the process if not filemapped, no need to write back to swap space since the process is exiting)
-            if (exitProc->pageTable[i].MODIFIED && exitProc->pageTable[i].FILE_MAPPED) {
-                if (O_flag) { cout << " FOUT" << endl; }
-                exitProc->stats->fouts++;  // Update pstats
-            }
-            exitProc->stats->unmaps++;  // Need this line???
-            // Free the frame mapped to this page of the exit process and add it back freeFrames
-            Frame_t& frameToFree = frameTable[exitProc->pageTable[i].FRAMENUMBER];
-            frameToFree.process = nullptr;
-            frameToFree.vPage = -1;
-            frameToFree.inUse = false;
-            freeFrames.push_back(&frameToFree);
+// Read a cost file ("name value" or "name = value" lines, # comments) or an operation-count file (same format).
+// Operations it does not name keep the values of base.
+InstrCost load_cost_file(const string& path, const InstrCost& base) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        cout << "Fail to open the cost file " << path << endl;
+        exit(2);
+    }
+    InstrCost costs = base;
+    string line;
+    while (getline(file, line)) {
+        replace(line.begin(), line.end(), '=', ' ');
+        istringstream iss(line);
+        string name, rest;
+        long value;
+        if (!(iss >> name) || name[0] == '#') { continue; }
+        const CostField* op = find_if(begin(costFields), end(costFields),
+                                      [&](const CostField& candidate) { return name == candidate.name; });
+        if (op == end(costFields) || !(iss >> value) || value < 0 || iss >> rest) {
+            cout << "Invalid cost line: " << line << endl;
+            exit(2);
         }
+        costs.*op->field = value;
     }
+    return costs;
 }
-
-// Unmap a frame from a page (for instructions "r" and "w")
-void unmap_frame_page(Frame_t* frame) {
-    Process* proc = frame->process;  // Current process mapped to this frame
-    Pte_t* pte = &proc->pageTable[frame->vPage];  // Current page mapped to this frame
-    // The process is not exiting!
-    if (O_flag) { cout << " UNMAP " << proc->processId << ":" << frame->vPage << endl; }
-        proc->stats->unmaps++;  // Update pstats
-
-    if (pte->MODIFIED) {  // It pte is modified/ dirty -> go to swap space (OUT) or the mappedfile (FOUT)
-        if (pte->FILE_MAPPED) {  // Go to its mappedfile
-            if (O_flag) { cout << " FOUT" << endl; }
-            proc->stats->fouts++;  // Update pstats
-        } else {  // Go to swap space
-            if (O_flag) { cout << " OUT" << endl; }
-            proc->stats->outs++;  // Update pstats
-            pte->PAGEDOUT = 1;  // The page is swapped out
-        }
-        pte->MODIFIED = 0;  // Reset the MODIFIED flag
-    // If the page is not modified before, unmap the page and the frame directly
-    } 
-    frame->process = nullptr;
-    frame->vPage = -1;
-    frame->inUse = false;
-    freeFrames.push_back(frame);  // The used frame has to be returned to the free pool 
-    pte->PRESENT = 0;  // The page now doesn't present in any frame 
+// Write the operation counts in the format of load_cost_file()
+void write_counts(const string& path, const InstrCost& counts) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        cout << "Fail to open the count file " << path << endl;
+        exit(2);
+    }
+    fprintf(file, "# operation counts\n");
+    for (const CostField& op: costFields) { fprintf(file, "%s %ld\n", op.name, counts.*op.field); }
+    fclose(file);
 }
-
-// Map a frame to a page
-void map_frame_page(Frame_t* frame, Process* proc, int vpage) {
-    Pte_t* pte = &proc->pageTable[vpage];
-    pte->PRESENT = 1;
-    pte->FRAMENUMBER = frame->f_id;
-    if (pte->FILE_MAPPED) {
-        if (O_flag) {cout << " FIN" << endl; }  // If the page is filemapped, load data from file 
-        proc->stats->fins++;  // Update pstats
-    } else {
-        if (pte->PAGEDOUT) {
-            if (O_flag) {cout << " IN" << endl; }  // If the page is not filemapped and was move to the swap space ("OUT" before), load data from swap space to the frame again
-            proc->stats->ins++;  // Update pstats
-        } else {  // The page was never swapped out and not filemapped
-            if (O_flag) { cout << " ZERO" << endl; }
-            proc->stats->zeros++;  // Update pstats
-        }
-    }
-    frame->inUse = true;
-    frame->process = proc;
-    frame->vPage = vpage;
-    frame->age = 0;
-    freeFrames.pop_front();
-    if (O_flag) {cout << " MAP " << frame->f_id << endl; }
-    proc->stats->maps++;
+// Print the cost of the operation counts under every cost profile of a comma-separated list of cost files
+void print_what_if(const InstrCost& counts, const string& profiles) {
+    stringstream ss(profiles);
+    string profile;
+    while (getline(ss, profile, ',')) {
+        printf("WHATIF %s TOTALCOST %llu\n", profile.c_str(), price(counts, load_cost_file(profile, InstrCost())));
+    }
 }
 
+// TLB in front of the page tables (--tlb): sets of ways entries, LRU within a set. An entry is tagged with the
+// page key, i.e. with the process (ASID) as well, so that with ASIDs entries of several processes can coexist;
+// without ASIDs the TLB is flushed whenever another process is switched to.
+class Tlb {
+    private:
+        int sets;
+        int ways;
+        vector<int> tags;  // Page key cached by each entry (set-major), -1 if invalid
+        vector<uint64_t> lastUse;  // For LRU within a set
+        uint64_t clock = 0;
+
+        int find(int key, int vpage) const {
+            int base = (vpage % sets) * ways;
+            for (int e = base; e < base + ways; e++) {
+                if (tags[e] == key) { return e; }
+            }
+            return -1;
+        }
+    public:
+        Tlb(int entries, int ways): sets(entries / ways), ways(ways), tags(entries, -1), lastUse(entries, 0) {}
+        // Look the page up, return whether it hit
+        bool lookup(int pid, int vpage) {
+            int e = find(page_key(pid, vpage), vpage);
+            if (e == -1) { return false; }
+            lastUse[e] = ++clock;
+            return true;
+        }
+        // Cache the translation of the page after a miss (replacing the LRU entry of its set)
+        void insert(int pid, int vpage) {
+            int base = (vpage % sets) * ways;
+            int victim = base;
+            for (int e = base; e < base + ways; e++) {
+                if (tags[e] == -1) {
+                    victim = e;
+                    break;
+                }
+                if (lastUse[e] < lastUse[victim]) { victim = e; }
+            }
+            tags[victim] = page_key(pid, vpage);
+            lastUse[victim] = ++clock;
+        }
+        // Drop the translation of an unmapped page, return whether it was cached (a shootdown was needed)
+        bool invalidate(int pid, int vpage) {
+            int e = find(page_key(pid, vpage), vpage);
+            if (e == -1) { return false; }
+            tags[e] = -1;
+            return true;
+        }
+        void flush() { fill(tags.begin(), tags.end(), -1); }
+        void save(SnapshotWriter& out) const {
+            out.put(tags);
+            out.put(lastUse);
+            out.put(clock);
+        }
+        void load(SnapshotReader& in) {
+            in.get(tags);
+            in.get(lastUse);
+            in.get(clock);
+        }
+};
+
+// Virtual base class of all pager algorithms
+class Pager{
+    public:
+        virtual ~Pager() {}
+        // virtual functions
+        virtual int select_victim_frame() = 0;  // Returns the id of the victim frame
+        // Notifications for pagers that keep their own bookkeeping (no-ops by default)
+        virtual void on_fault(int pid, int vpage) {}  // A valid page faults, before a frame is allocated for it
+        virtual void on_map(int frame) {}  // A page was mapped to the frame
+        virtual void on_unmap(int frame) {}  // The page mapped to the frame is about to be unmapped (eviction or exit)
+        virtual void on_reference(int frame, bool faulted) {}  // Called on every r/w to a resident page (after its R/M bits are set), faulted: the page was just faulted in by this access
+        // Checkpoints: write/restore the pager's own state (the frame table is saved by the simulation)
+        virtual void save(SnapshotWriter& out) const {}
+        virtual void load(SnapshotReader& in) {}
+};
 // Maintain the instruction table
 struct Instructions {
     char operation;  // c, r, w, e
     int vpage;
+    int cpu;  // CPU executing the instruction (optional third column, 0 if absent)
     // Constructor
-    Instructions(char type, int id): operation(type), vpage(id) {}
-    // Get the next process
+    Instructions(char type, int id, int cpu = 0): operation(type), vpage(id), cpu(cpu) {}
 };
-// Use a queue to store all instructions read
-queue<Instructions> instructions; 
 
-// Get next instruction from the queue
-bool get_next_instruction(char& operation, int& vpage) {
-    if (!instructions.empty()) {
-        Instructions currInstr = instructions.front();  // Get the next instruction
-        instructions.pop();  // Remove the next instruction from the queue
-        operation = currInstr.operation;
-        vpage = currInstr.vpage;
-        return true;
-    }
-    return false;
+// The parsed input file. It is read once and shared (read-only) by every simulation run over it.
+struct Trace {
+    vector<Vma> vmas;  // VMAs of all processes, process by process
+    vector<int> vmaStarts;  // First VMA of each process, and the number of VMAs at the end
+    vector<Instructions> instructions;  // All instructions in order
+    int numCpus = 1;  // Highest CPU id of the instructions + 1
+    bool hasFork = false;  // Some instruction forks a process
+};
+
+// Parse a count line of the process file (processes, VMAs of a process)
+bool parse_count(const string& line, int& count) {
+    istringstream iss(line);
+    return (iss >> count) && count >= 0;
 }
 
-// Virtual base class of all pager algorithms
-class Pager{
-    public:
-        // virtual functions
-        virtual Frame_t* select_victim_frame() = 0;
-};
+// Read the process file: the process/VMA specifications followed by the instructions. Returns the error message of
+// an unreadable or invalid file, an empty string on success.
+string read_trace(const string& processFile, Trace& trace) {
+    ifstream processFileStream(processFile);
+    if (!processFileStream.is_open()) { return "Fail to open the input file"; }
+    string line;
+    // Skip initial comment lines: continue looping until finding a line that is not empty and does not start with '#'
+    while (getline(processFileStream, line) && (line.empty() || line[0] == '#'));
+    // This line contains the number of processes
+    int processNum;
+    if (!parse_count(line, processNum)) { return "Invalid process count in " + processFile; }
+    trace.vmaStarts.reserve(processNum + 1);
+    // Process each process
+    for (int p = 0; p < processNum; p++) {
+        while (getline(processFileStream, line) && (line.empty() || line[0] == '#'));
+        // # of VMAs in the proces
+        int currVmaNum;  // Read current process's VMA count and store it in "line"
+        if (!parse_count(line, currVmaNum)) { return "Invalid VMA count in " + processFile; }
+        trace.vmaStarts.push_back(trace.vmas.size());
+        // Process VMAs in each process
+        for (int v = 0; v < currVmaNum; v++) {
+            getline(processFileStream, line);  // Read each line and store it in "line"
+            istringstream iss(line);  // iss: treat a string object like a stream, so can extract values from line
+            int start_vpage, end_vpage;
+            bool write_protected, file_mapped;
+            if (iss >> start_vpage >> end_vpage >> write_protected >> file_mapped) {
+                int page_order = 0;  // Optional page-size order: superpages of 2^order pages
+                if (!(iss >> page_order)) { page_order = 0; }
+                if (page_order < 0 || (1 << page_order) > pageTableSize) {
+                    return "Invalid page-size order " + to_string(page_order);
+                }
+                trace.vmas.push_back(Vma(start_vpage, end_vpage, write_protected, file_mapped, page_order));
+            }
+        }
+    }
+    trace.vmaStarts.push_back(trace.vmas.size());
+    // Read and store all instructions
+    vector<bool> started(processNum, false);  // Processes switched to or forked so far
+    while (getline(processFileStream, line)) {
+        if (line.empty() || line[0] == '#' || line.find("####") != string::npos) {
+            continue;
+        }
+        istringstream iss(line);
+        char instrType;
+        int instrValue;
+        if (iss >> instrType >> instrValue) {
+            int cpu = 0;
+            if (!(iss >> cpu)) { cpu = 0; }
+            if (cpu < 0 || cpu >= maxCpus) {
+                return "Invalid CPU id " + to_string(cpu);
+            }
+            trace.numCpus = max(trace.numCpus, cpu + 1);
+            if ((instrType == 'c' || instrType == 'e') && (instrValue < 0 || instrValue >= processNum)) {
+                return "Invalid process id " + to_string(instrValue);
+            }
+            if ((instrType == 'r' || instrType == 'w') && (instrValue < 0 || instrValue >= pageTableSize)) {
+                return "Invalid virtual page " + to_string(instrValue);
+            }
+            // "f <pid>" forks the current process into a declared process that has not run yet
+            if (instrType == 'f') {
+                if (instrValue < 0 || instrValue >= processNum || started[instrValue]) {
+                    return "Invalid fork target " + to_string(instrValue);
+                }
+                trace.hasFork = true;
+            }
+            if ((instrType == 'c' || instrType == 'f') && instrValue >= 0 && instrValue < processNum) { started[instrValue] = true; }
+            trace.instructions.push_back(Instructions(instrType, instrValue, cpu));
+        }
+    }
+    return "";
+}
+// Read the process file, or stop with its error
+Trace load_trace(const string& processFile) {
+    Trace trace;
+    string error = read_trace(processFile, trace);
+    if (!error.empty()) {
+        cout << error << endl;
+        exit(2);
+    }
+    return trace;
+}
 
 // FIFO pager
-class FIFO: public Pager {
+class FIFO final: public Pager {
     private:
-        vector<Frame_t>& frameTable;
+        FrameTable& frameTable;
         int hand = 0;
     public:
-        FIFO(vector<Frame_t>& frameTable): frameTable(frameTable) {}  // constructor
-        Frame_t* select_victim_frame() override {
+        FIFO(FrameTable& frameTable): frameTable(frameTable) {}  // constructor
+        int select_victim_frame() override {
             // Use the frame at the current "hand" position
-            Frame_t* victimFrame = &frameTable[hand];
+            int victimFrame = hand;
             // Move "hand" to the next frame (with wraparound)
             hand = (hand + 1) % frameTable.size();
             return victimFrame;
         }
+        void save(SnapshotWriter& out) const override { out.put(hand); }
+        void load(SnapshotReader& in) override { in.get(hand); }
 };
 
 // Clock pager
-class Clock: public Pager {
+class Clock final: public Pager {
     private:
-        vector<Frame_t>& frameTable;
+        FrameTable& frameTable;
         int hand = 0;
     public:
-        Clock(vector<Frame_t>& frameTable): frameTable(frameTable) {}  // constructor
-        Frame_t* select_victim_frame() override {
+        Clock(FrameTable& frameTable): frameTable(frameTable) {}  // constructor
+        int select_victim_frame() override {
             while (true) {
-                Frame_t* victimFrame = &frameTable[hand];
+                int victimFrame = hand;
+                hand = (hand + 1) % frameTable.size();
                 // Check if the page is referenced recently, if yes, give it another chance
-                if (!victimFrame->process->pageTable[victimFrame->vPage].REFERENCED) {
-                    hand = (hand + 1) % frameTable.size();
+                if (!frameTable.referenced(victimFrame)) {
                     return victimFrame;
-                } else {
-                    victimFrame->process->pageTable[victimFrame->vPage].REFERENCED = 0;
-                    hand = (hand + 1) % frameTable.size();
                 }
+                frameTable.referencedBits.reset(victimFrame);
             }
         }
+        void save(SnapshotWriter& out) const override { out.put(hand); }
+        void load(SnapshotReader& in) override { in.get(hand); }
 };
 
 // Define the function used to get a random number
-int myrandom(vector<int> randNumbers) { 
+int myrandom(const vector<int>& randNumbers, int& ofs, int numFrames) { 
     int randNum = randNumbers[ofs] % numFrames;
-    if (ofs+1 < randNumCnt) {
+    if (ofs+1 < (int)randNumbers.size()) {
         ofs++;
     } else {
         ofs = 0;  // Wrap around when running out of numbers in the file/array
     }
     return randNum;
 }
+
+// xoshiro256** generator, seeded through splitmix64
+struct Xoshiro256 {
+    uint64_t s[4];
+    explicit Xoshiro256(uint64_t seed) {
+        for (uint64_t& word: s) {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+    // Uniform number in [0, n) (multiply-shift on the high 32 bits)
+    int below(int n) { return (int)(((next() >> 32) * (uint64_t)n) >> 32); }
+};
+
+// Random numbers of the Random pager: the numbers of the rfile, read once and shared read-only by all runs,
+// or a seeded PRNG (--seed) for runs too long for any rfile
+struct RandomSource {
+    vector<int> values;  // Numbers loaded from the rfile
+    bool seeded = false;  // Use the PRNG instead of the rfile
+    uint64_t seed = 0;
+};
+
 // Random pager
-class Random: public Pager {
+class Random final: public Pager {
     private: 
-        vector<Frame_t>& frameTable;
+        FrameTable& frameTable;
+        const RandomSource& source;
+        int ofs = 0;  // To get the random number
+        Xoshiro256 prng;  // Own generator of the run when the source is seeded
     public:
-        Random(vector<Frame_t>& frameTable): frameTable(frameTable) {}
-        Frame_t* select_victim_frame() override {
-            int randNum = myrandom(randvals);
-            Frame_t* victimFrame = &frameTable[randNum];
-            return victimFrame;
+        Random(FrameTable& frameTable, const RandomSource& source): frameTable(frameTable), source(source), prng(source.seed) {}
+        int select_victim_frame() override {
+            if (source.seeded) { return prng.below(frameTable.size()); }
+            return myrandom(source.values, ofs, frameTable.size());
+        }
+        void save(SnapshotWriter& out) const override {
+            out.put(ofs);
+            out.put(prng);
+        }
+        void load(SnapshotReader& in) override {
+            in.get(ofs);
+            in.get(prng);
         }
 };
 
 // Define the daemon function to reset the REFERENCED bits for all pages mapped to a frame every 48 instructions
-static int instrCounter = 0;
-void daemon(vector<Frame_t>& frameTable) {
+void daemon(FrameTable& frameTable, int& instrCounter) {
     if (instrCounter >= 48) {
-        for (vector<Frame_t>::iterator frame = frameTable.begin(); frame != frameTable.end(); frame++) {
-            if (frame->inUse && frame->process && frame->vPage != -1) {
-                frame->process->pageTable[frame->vPage].REFERENCED = 0;
-            }
-        }
-        instrCounter = 0;  // Reset the global counter
+        frameTable.referencedBits.clear();  // Unused frames never have the bit set
+        instrCounter = 0;  // Reset the counter
     }
 }
 // NRU (ESC) pager
-class NRU: public Pager {
+// The frames of each class (2 * R + M) are computed a word at a time from the R/M bitsets, the victim is the
+// first frame after the hand in the lowest non-empty class.
+class NRU final: public Pager {
     private: 
-        vector<Frame_t>& frameTable;
+        FrameTable& frameTable;
+        int& instrCounter;  // Instructions since the last daemon run
         int hand = 0;
+        FrameBitset classBits[4];  // Frames of each class
     public:
-        NRU(vector<Frame_t>& frameTable): frameTable(frameTable) {}
-        Frame_t* select_victim_frame() override {
-            int classToReplace = 4;  // First set this as a value larger than 3 (since 3 is the possible largest class)
-            Frame_t* victimFrame = nullptr;
-
-            for (int i = 0; i < frameTable.size(); i++) {
-                int idx = (hand + i) % frameTable.size();  // Circular scan
-                Frame_t& currFrame = frameTable[idx];
-                // Get the PTE of mapped to this frame
-                Pte_t& currPte = currFrame.process->pageTable[currFrame.vPage];
-                int frameClass = 2 * currPte.REFERENCED + currPte.MODIFIED;
-                if (frameClass < classToReplace) {
-                    victimFrame = &currFrame;
-                    classToReplace = frameClass;
-                    if (frameClass == 0) { break; }  // Stop when we find a class 0
-                }
+        NRU(FrameTable& frameTable, int& instrCounter): frameTable(frameTable), instrCounter(instrCounter) {
+            for (FrameBitset& frames: classBits) { frames.resize(frameTable.size()); }
+        }
+        int select_victim_frame() override {
+            int frameNum = frameTable.size();
+            int victimFrame = -1;
+            // Every frame is in use when a victim is needed
+            for (size_t w = 0; w < classBits[0].words.size(); w++) {
+                uint64_t r = frameTable.referencedBits.words[w];
+                uint64_t m = frameTable.modifiedBits.words[w];
+                classBits[0].words[w] = ~r & ~m;
+                classBits[1].words[w] = ~r & m;
+                classBits[2].words[w] = r & ~m;
+                classBits[3].words[w] = r & m;
+            }
+            for (const FrameBitset& frames: classBits) {
+                victimFrame = frames.find_next(hand, frameNum);
+                if (victimFrame == -1) { victimFrame = frames.find_next(0, hand); }
+                if (victimFrame != -1) { break; }
             }
             // Call daemon to reset REFERENCED bits if needed
-            daemon(frameTable);  
+            daemon(frameTable, instrCounter);  
 
-            if (victimFrame != nullptr) {  // Update hand for the next call after a victimFrame is correctly selected
-                hand = (victimFrame->f_id + 1) % frameTable.size();
+            if (victimFrame != -1) {  // Update hand for the next call after a victimFrame is correctly selected
+                hand = (victimFrame + 1) % frameTable.size();
             }
             return victimFrame;
         }
+        // classBits is recomputed on every call
+        void save(SnapshotWriter& out) const override { out.put(hand); }
+        void load(SnapshotReader& in) override { in.get(hand); }
 };
 
 // Aging pager
-class Aging: public Pager {
+class Aging final: public Pager {
     private: 
-        vector<Frame_t>& frameTable;
+        FrameTable& frameTable;
         int hand = 0;
     public:
-        Aging(vector<Frame_t>& frameTable): frameTable(frameTable) {}
-        Frame_t* select_victim_frame() override {
+        Aging(FrameTable& frameTable): frameTable(frameTable) {}
+        int select_victim_frame() override {
             for (int i = 0; i < frameTable.size(); i++) {
                 int currIdx = (hand + i) % frameTable.size();
-                Frame_t& currFrame = frameTable[currIdx];
-                if (currFrame.inUse) {
-                    currFrame.age >>= 1;
+                if (frameTable.inUse(currIdx)) {
+                    frameTable.age[currIdx] >>= 1;
                     // If the page was referenced recently, set its leading bit to 1
-                    if (currFrame.process->pageTable[currFrame.vPage].REFERENCED) {
-                        currFrame.age |= 0x80000000;  // Set the MSB if the page was recently referenced
-                        currFrame.process->pageTable[currFrame.vPage].REFERENCED = 0;  // Reset the referenced bit
+                    if (frameTable.referenced(currIdx)) {
+                        frameTable.age[currIdx] |= 0x80000000;  // Set the MSB if the page was recently referenced
+                        frameTable.referencedBits.reset(currIdx);  // Reset the referenced bit
                     }
                 }
             }
             // Then find the victim frame
             // The youngest page will have the biggest age (bit value) and the oldest page to be unmapped will have the smallest age
             unsigned int minAge = UINT_MAX;  // The oldest page (vicitm frame) will have the min age (minAge = oldest page)
-            Frame_t* victimFrame = nullptr;
+            int victimFrame = -1;
             int victimIdx = hand;  // Start from the current hand position
 
             for (int i = 0; i < frameTable.size(); i++) {
                 int currIdx = (hand + i) % frameTable.size();
-                Frame_t& currFrame = frameTable[currIdx];
 
                 // Check for victim frame
-                if (currFrame.inUse && currFrame.age < minAge) {
-                    minAge = currFrame.age;
-                    victimFrame = &currFrame;
+                if (frameTable.inUse(currIdx) && frameTable.age[currIdx] < minAge) {
+                    minAge = frameTable.age[currIdx];
+                    victimFrame = currIdx;
                     victimIdx = currIdx;
                 }
             }
@@ -411,229 +779,3002 @@ class Aging: public Pager {
             
             return victimFrame;
         }
+        // The ages are in the frame table
+        void save(SnapshotWriter& out) const override { out.put(hand); }
+        void load(SnapshotReader& in) override { in.get(hand); }
 };
 
-// Working-set pager
-int currentTime = 0;  // Used to calculate TAU (by instructions)
-class WorkingSet: public Pager {
+// Working-set pager (WSClock)
+// Frames are kept in a list ordered by time_last_used (oldest first). The old (idle for more than TAU) unreferenced
+// frames that are eligible for replacement are tracked in a bitset next to the frame table's R bitset (the frames
+// referenced since the hand last passed them). The victim is the first eligible frame after the hand, and only the referenced frames
+// the hand passes on its way get their time_last_used refreshed, so a fault never sweeps every frame. If no frame
+// is eligible, the oldest frame is taken from the head of the list instead of searching for it.
+class WorkingSet final: public Pager {
     private:
-        vector<Frame_t>& frameTable;
+        FrameTable& frameTable;
+        const int& currentTime;  // Used to calculate TAU (by instructions)
+        int TAU;  // Time criteria (-t)
         int hand = 0;
-    public:
-        WorkingSet(vector<Frame_t>& frameTable): frameTable(frameTable) {}
-        Frame_t* select_victim_frame() override {
-            static const int TAU = 49;  // Time criteria
-            int oldestTime = INT_MAX;
-            Frame_t* oldestFrame = nullptr;
-            Frame_t* victimFrame = nullptr;
+        IdLinks links;
+        IdList byTime;  // Frames ordered by time_last_used
+        int youngHead = -1;  // First frame of the list that is not older than TAU yet, -1 if every frame is old
+        FrameBitset eligibleBits;  // Frames older than TAU and not referenced
 
-            for (int i = 0; i < frameTable.size(); i++) {
-                Frame_t& currFrame = frameTable[(hand + i) % frameTable.size()];
-
-                // Update the "time_last_used" of the frame based on whether it's referenced recently or its TAU
-                // If the page is REFERENCED recently, set time_last_used to currentTime and reset its REFERENCED to 0
-                if (currFrame.process && currFrame.process->pageTable[currFrame.vPage].REFERENCED) {
-                    // Keep the previous state of the REFERENCED bit to print the correct "R" state at the end 
-                    currFrame.process->pageTable[currFrame.vPage].PRE_REFERENCED = currFrame.process->pageTable[currFrame.vPage].REFERENCED;
-                    currFrame.process->pageTable[currFrame.vPage].REFERENCED = 0;
-                    currFrame.time_last_used = currentTime;
-                }
-                // Check eligibility after resetting the REFERENCED bits
-                if (!currFrame.process->pageTable[currFrame.vPage].REFERENCED && currentTime - currFrame.time_last_used > TAU) {
-                    currFrame.canReplace = true;
+        // The hand passes a referenced frame: reset its REFERENCED bit and move it to the young end of the list
+        void refresh(int f) {
+            frameTable.bits[f] |= FRAME_PRE_REFERENCED;  // Keep the previous state of the REFERENCED bit to print the correct "R" state at the end
+            frameTable.referencedBits.reset(f);
+            frameTable.time_last_used[f] = currentTime;
+            if (youngHead == f) { youngHead = links.next[f]; }
+            links.remove(byTime, f);
+            links.push_back(byTime, f);
+            if (youngHead == -1) { youngHead = f; }
+        }
+        // Refresh the referenced frames in [from, to)
+        void refresh_range(int from, int to) {
+            const FrameBitset& referencedBits = frameTable.referencedBits;
+            for (int f = referencedBits.find_next(from, to); f != -1; f = referencedBits.find_next(f + 1, to)) {
+                refresh(f);
+            }
+        }
+    public:
+        WorkingSet(FrameTable& frameTable, const int& currentTime, int tau): frameTable(frameTable), currentTime(currentTime), TAU(tau) {
+            int frameNum = frameTable.size();
+            links.resize(frameNum);
+            for (int f = 0; f < frameNum; f++) { links.push_back(byTime, f); }  // All frames start with the same time_last_used
+            youngHead = byTime.front;
+            eligibleBits.resize(frameNum);
+        }
+        void on_reference(int frame, bool faulted) override {
+            eligibleBits.reset(frame);
+        }
+        int select_victim_frame() override {
+            int frameNum = frameTable.size();
+            // Frames whose last use dropped out of the working-set window become old
+            while (youngHead != -1 && currentTime - frameTable.time_last_used[youngHead] > TAU) {
+                if (!frameTable.referenced(youngHead)) { eligibleBits.set(youngHead); }
+                youngHead = links.next[youngHead];
+            }
+            // Select the first frame after the hand that is eligible to be replaced
+            int victimFrame = eligibleBits.find_next(hand, frameNum);
+            if (victimFrame == -1) { victimFrame = eligibleBits.find_next(0, hand); }
+            if (victimFrame != -1) {
+                // The hand passes [hand, victimFrame)
+                if (victimFrame >= hand) {
+                    refresh_range(hand, victimFrame);
                 } else {
-                    currFrame.canReplace = false;
-                }
-                // Select the first frame that is eligible to be replaced
-                if (currFrame.canReplace) {
-                    victimFrame = &currFrame;
-                    break;
+                    refresh_range(hand, frameNum);
+                    refresh_range(0, victimFrame);
                 }
-                // Track the oldest frame in case no eligible frame is found (The smaller the frame's time_last_used is, the older it is)
-                if (currFrame.time_last_used < oldestTime) {
-                    oldestTime = currFrame.time_last_used;
-                    oldestFrame = &currFrame;
+            } else {
+                // No eligible frame: the hand goes all the way around, then use the oldest frame
+                refresh_range(hand, frameNum);
+                refresh_range(0, hand);
+                // Among the frames with the same (oldest) time_last_used, take the first one after the hand
+                int oldestTime = frameTable.time_last_used[byTime.front];
+                int bestDistance = INT_MAX;
+                for (int f = byTime.front; f != -1 && frameTable.time_last_used[f] == oldestTime; f = links.next[f]) {
+                    int distance = (f - hand + frameNum) % frameNum;
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        victimFrame = f;
+                    }
                 }
             }
-            // If no eligible frame is found, use the oldest frame
-            if (!victimFrame) {
-                victimFrame = oldestFrame;
-            }
             // Update hand for the next round
-            hand = (victimFrame->f_id + 1) % frameTable.size();
+            hand = (victimFrame + 1) % frameNum;
 
             return victimFrame;
         }
+        void save(SnapshotWriter& out) const override {
+            out.put(hand);
+            out.put(links);
+            out.put(byTime);
+            out.put(youngHead);
+            out.put(eligibleBits);
+        }
+        void load(SnapshotReader& in) override {
+            in.get(hand);
+            in.get(links);
+            in.get(byTime);
+            in.get(youngHead);
+            in.get(eligibleBits);
+        }
 };
 
-// First initialize a pager object 
-Pager* pager;
+// ARC pager (Adaptive Replacement Cache, Megiddo & Modha)
+// T1 holds the resident pages referenced once since they were faulted in, T2 the ones referenced again. B1/B2 are
+// ghost lists remembering the pages recently evicted from T1/T2. A fault on a ghost page moves the target size p
+// of T1 towards the list it was found in, so a sequential sweep only cycles through T1 and leaves T2 alone.
+// Every reference and every fault is O(1).
+class ARC final: public Pager {
+    private:
+        enum { NONE = 0, T1, T2, B1, B2 };
+        FrameTable& frameTable;
+        int c;  // Cache size (number of frames)
+        int p = 0;  // Target size of T1
+        IdLinks frameLinks;  // T1 and T2 (by frame id)
+        IdList t1, t2;
+        vector<uint8_t> frameList;  // T1/T2/NONE per frame
+        IdLinks keyLinks;  // B1 and B2 (by page key)
+        IdList b1, b2;
+        vector<uint8_t> keyList;  // B1/B2/NONE per page key
+        uint8_t faultGhost = NONE;  // Ghost list the faulting page was found in
+        bool evictT1Only = false;  // T1 holds the whole cache and B1 is empty: drop the LRU page of T1 without a ghost
 
-// Get the next frame that should be mapped to the page after consulting the pagers
-Frame_t* get_frame() {
-    Frame_t* frame = nullptr;
-    // If there are free frames
-    if (!freeFrames.empty()) {
-        frame = freeFrames.front();  // Get the first (oldest) free frame's memory address
-        // freeFrames.pop_front();
-    } else {  // There's no any free frame -> paging
-        frame = pager->select_victim_frame();
-    }
-    return frame;
-}
+        int frame_key(int f) const { return page_key(frameTable.pid[f], frameTable.vPage[f]); }
+        void ensure_key(int key) {
+            if (key >= (int)keyList.size()) {
+                keyList.resize(key + 1, NONE);
+                keyLinks.resize(key + 1);
+            }
+        }
+        void drop_ghost(IdList& ghosts) {
+            keyList[keyLinks.pop_front(ghosts)] = NONE;
+        }
+        // Evict the LRU page of T1 or T2 and remember it in the matching ghost list
+        int evict(IdList& list, IdList& ghosts, uint8_t ghostList, bool keepGhost) {
+            int f = frameLinks.pop_front(list);
+            frameList[f] = NONE;
+            if (keepGhost) {
+                int key = frame_key(f);
+                ensure_key(key);
+                keyLinks.push_back(ghosts, key);
+                keyList[key] = ghostList;
+            }
+            return f;
+        }
+    public:
+        ARC(FrameTable& frameTable, int numPageKeys): frameTable(frameTable), c(frameTable.size()) {
+            frameLinks.resize(c);
+            frameList.assign(c, NONE);
+            keyLinks.resize(numPageKeys);
+            keyList.assign(numPageKeys, NONE);
+        }
+        void on_fault(int pid, int vpage) override {
+            int key = page_key(pid, vpage);
+            ensure_key(key);
+            faultGhost = keyList[key];
+            evictT1Only = false;
+            if (faultGhost == B1) {  // Recency would have kept it: grow T1
+                p = min(c, p + max(b2.size / b1.size, 1));
+                keyLinks.remove(b1, key);
+                keyList[key] = NONE;
+            } else if (faultGhost == B2) {  // Frequency would have kept it: shrink T1
+                p = max(0, p - max(b1.size / b2.size, 1));
+                keyLinks.remove(b2, key);
+                keyList[key] = NONE;
+            } else {  // A new page: keep |T1|+|B1| <= c and the total directory size <= 2c
+                int l1 = t1.size + b1.size;
+                if (l1 >= c) {
+                    if (t1.size < c) { drop_ghost(b1); } else { evictT1Only = true; }
+                } else if (l1 + t2.size + b2.size >= 2 * c && b2.size > 0) {
+                    drop_ghost(b2);
+                }
+            }
+        }
+        int select_victim_frame() override {
+            if (evictT1Only) {
+                return evict(t1, b1, B1, false);
+            }
+            if (t1.size > 0 && (t1.size > p || (faultGhost == B2 && t1.size == p) || t2.size == 0)) {
+                return evict(t1, b1, B1, true);
+            }
+            return evict(t2, b2, B2, true);
+        }
+        void on_map(int frame) override {
+            // A page found in a ghost list has been referenced at least twice recently
+            if (faultGhost == B1 || faultGhost == B2) {
+                frameLinks.push_back(t2, frame);
+                frameList[frame] = T2;
+            } else {
+                frameLinks.push_back(t1, frame);
+                frameList[frame] = T1;
+            }
+            faultGhost = NONE;
+        }
+        void on_unmap(int frame) override {
+            // Pages evicted by select_victim_frame() are already off T1/T2, this handles exiting processes
+            if (frameList[frame] == T1) { frameLinks.remove(t1, frame); }
+            if (frameList[frame] == T2) { frameLinks.remove(t2, frame); }
+            frameList[frame] = NONE;
+        }
+        void on_reference(int frame, bool faulted) override {
+            if (faulted) { return; }  // The access that faulted the page in is not a hit
+            // A hit moves the page to the MRU end of T2
+            if (frameList[frame] == T1) {
+                frameLinks.remove(t1, frame);
+            } else {
+                frameLinks.remove(t2, frame);
+            }
+            frameLinks.push_back(t2, frame);
+            frameList[frame] = T2;
+        }
+        void save(SnapshotWriter& out) const override {
+            out.put(p);
+            out.put(frameLinks);
+            out.put(t1);
+            out.put(t2);
+            out.put(frameList);
+            out.put(keyLinks);
+            out.put(b1);
+            out.put(b2);
+            out.put(keyList);
+            out.put(faultGhost);
+            out.put(evictT1Only);
+        }
+        void load(SnapshotReader& in) override {
+            in.get(p);
+            in.get(frameLinks);
+            in.get(t1);
+            in.get(t2);
+            in.get(frameList);
+            in.get(keyLinks);
+            in.get(b1);
+            in.get(b2);
+            in.get(keyList);
+            in.get(faultGhost);
+            in.get(evictT1Only);
+        }
+};
 
-// Handle page fault: If the page is valid (belongs to a VMA), allocate a frame to it
-void pagefault_handler(Pte_t* pte, vector<Vma>* vmaTable, int vpage) {
-    // If the page is not valid or not confirmed valid (belongs to a VMA) before, check it
-    if (!pte->VALID_VMA) {
-        for (Vma& vma: *vmaTable) {  // Check whether the page belongs to a VMA and record it 
-            if (vpage >= vma.startVpage && vpage <= vma.endVpage) {
-                pte->VALID_VMA = 1;
-                // Also update the page's WRITE_PROTECT and FILE_MAPPED variables too since it's valid
-                if (vma.fileMapped) { pte->FILE_MAPPED = 1; }
-                if (vma.writeProtected) { pte->WRITE_PROTECT = 1; }
-                break;
-            } 
+// CLOCK-Pro pager (Jiang, Chen & Zhang)
+// Resident pages are hot or cold. A cold page starts a test period when it is faulted in (or re-referenced), and
+// when it is evicted during its test period it stays on the clock as a non-resident ghost. A fault on a ghost
+// means its reuse distance is short: the page comes back hot and the target number of cold pages grows. Three
+// hands sweep the single clock: HAND_cold finds victims among the cold pages, HAND_hot demotes hot pages to cold,
+// and HAND_test ends test periods to bound the number of ghosts. References only set a bit per frame; the access
+// that faults a page in does not count, otherwise every new cold page would look re-referenced.
+class ClockPro final: public Pager {
+    private:
+        enum { IN_LIST = 0x1, RESIDENT = 0x2, HOT = 0x4, TEST = 0x8 };
+        FrameTable& frameTable;
+        int m;  // Number of frames
+        int coldTarget = 1;  // Adaptive target number of resident cold pages (m_c)
+        int hotNum = 0, coldNum = 0, ghostNum = 0;  // Resident hot/cold pages and non-resident test pages
+        vector<int> prev, next;  // Circular list (the clock) over page keys
+        vector<uint8_t> state;  // Flags per page key
+        vector<int> frameOf;  // Frame of each resident page key
+        FrameBitset hitBits;  // Frames referenced since a hand last passed them
+        int handHot = -1, handCold = -1, handTest = -1;
+        bool faultGhost = false;  // The faulting page was a non-resident page in its test period
+
+        int frame_key(int f) const { return page_key(frameTable.pid[f], frameTable.vPage[f]); }
+        void ensure_key(int key) {
+            if (key >= (int)state.size()) {
+                prev.resize(key + 1, -1);
+                next.resize(key + 1, -1);
+                state.resize(key + 1, 0);
+                frameOf.resize(key + 1, -1);
+            }
         }
-        // After checking and the page is not valid (doesn't belong to a VMA) -> a SEGV output line must be created
-        if (!pte->VALID_VMA) {  
-            segv = true;
-            return;  // The page is invalid, return directly
+        int hot_limit() const { return m - coldTarget; }
+        // Insert at the list head, which is right behind HAND_hot (the position its hands reach last)
+        void insert_head(int key) {
+            state[key] |= IN_LIST;
+            if (handHot == -1) {
+                prev[key] = next[key] = key;
+                handHot = handCold = handTest = key;
+                return;
+            }
+            int after = prev[handHot];
+            prev[key] = after;
+            next[key] = handHot;
+            next[after] = key;
+            prev[handHot] = key;
         }
-    }
-    // If the page is (already) confirmed valid (belongs to a VMA) 
-    Frame_t* frame = get_frame();  // Allocate or reclaim a frame
-    if (frame->inUse) {
-        unmap_frame_page(frame); 
-    }
-    map_frame_page(frame, currProc, vpage);
-}
+        void remove(int key) {
+            int successor = next[key] == key ? -1 : next[key];
+            if (handHot == key) { handHot = successor; }
+            if (handCold == key) { handCold = successor; }
+            if (handTest == key) { handTest = successor; }
+            if (successor != -1) {
+                next[prev[key]] = next[key];
+                prev[next[key]] = prev[key];
+            }
+            state[key] &= ~IN_LIST;
+        }
+        // A test period ends without a re-reference: a smaller cold target would have sufficed
+        void end_test(int key) {
+            state[key] &= ~TEST;
+            coldTarget = max(1, coldTarget - 1);
+            if (!(state[key] & RESIDENT)) {
+                remove(key);
+                state[key] = 0;
+                ghostNum--;
+            }
+        }
+        bool referenced(int key) const { return hitBits.test(frameOf[key]); }
+        void clear_reference(int key) { hitBits.reset(frameOf[key]); }
+        // HAND_hot: demote the first unreferenced hot page to cold, ending test periods it passes
+        void run_hand_hot() {
+            while (true) {
+                int key = handHot;
+                handHot = next[key];
+                if (state[key] & HOT) {
+                    if (referenced(key)) {
+                        clear_reference(key);
+                    } else {
+                        state[key] &= ~HOT;
+                        hotNum--;
+                        coldNum++;
+                        return;
+                    }
+                } else if (state[key] & TEST) {
+                    end_test(key);
+                }
+            }
+        }
+        // HAND_test: end test periods until the number of ghosts is bounded by m
+        void run_hand_test() {
+            while (ghostNum > m) {
+                int key = handTest;
+                handTest = next[key];
+                if (!(state[key] & HOT) && (state[key] & TEST)) { end_test(key); }
+            }
+        }
+        void enforce_hot_limit() {
+            while (hotNum > hot_limit() && hotNum > 0) { run_hand_hot(); }
+        }
+    public:
+        ClockPro(FrameTable& frameTable, int numPageKeys): frameTable(frameTable), m(frameTable.size()) {
+            prev.assign(numPageKeys, -1);
+            next.assign(numPageKeys, -1);
+            state.assign(numPageKeys, 0);
+            frameOf.assign(numPageKeys, -1);
+            hitBits.resize(m);
+        }
+        void on_fault(int pid, int vpage) override {
+            int key = page_key(pid, vpage);
+            ensure_key(key);
+            faultGhost = (state[key] & IN_LIST) && !(state[key] & RESIDENT);
+            if (faultGhost) { coldTarget = min(max(1, m - 1), coldTarget + 1); }
+        }
+        int select_victim_frame() override {
+            // HAND_cold: the first unreferenced resident cold page is the victim
+            while (true) {
+                int key = handCold;
+                handCold = next[key];
+                if (!(state[key] & RESIDENT) || (state[key] & HOT)) { continue; }
+                if (!referenced(key)) {
+                    int victimFrame = frameOf[key];
+                    hitBits.reset(victimFrame);
+                    frameOf[key] = -1;
+                    coldNum--;
+                    state[key] &= ~RESIDENT;
+                    if (state[key] & TEST) {  // Keep it as a ghost until its test period ends
+                        ghostNum++;
+                        run_hand_test();
+                    } else {
+                        remove(key);
+                        state[key] = 0;
+                    }
+                    return victimFrame;
+                }
+                clear_reference(key);
+                remove(key);
+                if (state[key] & TEST) {  // Re-referenced during its test period: promote to hot
+                    state[key] = (state[key] & ~TEST) | HOT;
+                    coldNum--;
+                    hotNum++;
+                    insert_head(key);
+                    enforce_hot_limit();
+                } else {  // Start a new test period
+                    state[key] |= TEST;
+                    insert_head(key);
+                }
+            }
+        }
+        void on_map(int frame) override {
+            int key = frame_key(frame);
+            ensure_key(key);
+            if (state[key] & IN_LIST) {  // The ghost of the faulting page is replaced by the resident page
+                remove(key);
+                ghostNum--;
+            }
+            frameOf[key] = frame;
+            if (faultGhost || hotNum < hot_limit()) {
+                state[key] = RESIDENT | HOT;
+                hotNum++;
+            } else {
+                state[key] = RESIDENT | TEST;
+                coldNum++;
+            }
+            insert_head(key);
+            enforce_hot_limit();
+            faultGhost = false;
+        }
+        void on_reference(int frame, bool faulted) override {
+            if (!faulted) { hitBits.set(frame); }
+        }
+        void on_unmap(int frame) override {
+            // Pages evicted by select_victim_frame() are no longer resident, this handles exiting processes
+            int key = frame_key(frame);
+            if (key >= (int)state.size() || !(state[key] & RESIDENT)) { return; }
+            if (state[key] & HOT) { hotNum--; } else { coldNum--; }
+            hitBits.reset(frame);
+            remove(key);
+            state[key] = 0;
+            frameOf[key] = -1;
+        }
+        void save(SnapshotWriter& out) const override {
+            out.put(coldTarget);
+            out.put(hotNum);
+            out.put(coldNum);
+            out.put(ghostNum);
+            out.put(prev);
+            out.put(next);
+            out.put(state);
+            out.put(frameOf);
+            out.put(hitBits);
+            out.put(handHot);
+            out.put(handCold);
+            out.put(handTest);
+            out.put(faultGhost);
+        }
+        void load(SnapshotReader& in) override {
+            in.get(coldTarget);
+            in.get(hotNum);
+            in.get(coldNum);
+            in.get(ghostNum);
+            in.get(prev);
+            in.get(next);
+            in.get(state);
+            in.get(frameOf);
+            in.get(hitBits);
+            in.get(handHot);
+            in.get(handCold);
+            in.get(handTest);
+            in.get(faultGhost);
+        }
+};
+
+// LRU pager (exact)
+// Resident frames are kept on an intrusive recency list: every reference moves its frame to the back in O(1) and
+// the victim is the frame at the front.
+class LRU final: public Pager {
+    private:
+        IdLinks links;
+        IdList recency;  // Least recently used at the front
+        vector<bool> listed;
+    public:
+        LRU(FrameTable& frameTable) {
+            links.resize(frameTable.size());
+            listed.assign(frameTable.size(), false);
+        }
+        int select_victim_frame() override {
+            int victimFrame = links.pop_front(recency);
+            listed[victimFrame] = false;
+            return victimFrame;
+        }
+        void on_map(int frame) override {
+            links.push_back(recency, frame);
+            listed[frame] = true;
+        }
+        void on_unmap(int frame) override {
+            if (listed[frame]) {
+                links.remove(recency, frame);
+                listed[frame] = false;
+            }
+        }
+        void on_reference(int frame, bool faulted) override {
+            links.remove(recency, frame);
+            links.push_back(recency, frame);
+        }
+        void save(SnapshotWriter& out) const override {
+            out.put(links);
+            out.put(recency);
+            out.put(listed);
+        }
+        void load(SnapshotReader& in) override {
+            in.get(links);
+            in.get(recency);
+            in.get(listed);
+        }
+};
+
+// LFU pager (exact, O(1) frequency buckets)
+// Buckets of frames with the same reference count form a list sorted by count. A reference moves the frame to the
+// neighbouring bucket (creating it if needed), and the victim is the least recently used frame of the lowest
+// bucket. Counts start at 1 when a page is mapped and are forgotten when it is unmapped.
+class LFU final: public Pager {
+    private:
+        struct Bucket {
+            long count = 0;  // Reference count shared by the frames in this bucket
+            IdList frames;  // Least recently used at the front
+            int prev = -1, next = -1;  // Neighbouring buckets (lower/higher count)
+        };
+        vector<Bucket> buckets;  // Bucket pool (at most one bucket per frame is in use)
+        vector<int> freeBuckets;
+        int lowest = -1;  // Bucket with the lowest count
+        IdLinks links;
+        vector<int> bucketOf;  // Bucket of each frame, -1 if not resident
+
+        // Create a bucket for count, linked right after bucket "after" (-1: at the start of the bucket list)
+        int new_bucket(long count, int after) {
+            int b = freeBuckets.back();
+            freeBuckets.pop_back();
+            buckets[b].count = count;
+            buckets[b].frames = IdList();
+            buckets[b].prev = after;
+            buckets[b].next = after == -1 ? lowest : buckets[after].next;
+            if (buckets[b].next != -1) { buckets[buckets[b].next].prev = b; }
+            if (after == -1) { lowest = b; } else { buckets[after].next = b; }
+            return b;
+        }
+        void remove_frame(int frame) {
+            int b = bucketOf[frame];
+            links.remove(buckets[b].frames, frame);
+            bucketOf[frame] = -1;
+            if (buckets[b].frames.size == 0) {  // Drop the empty bucket
+                if (buckets[b].prev != -1) { buckets[buckets[b].prev].next = buckets[b].next; } else { lowest = buckets[b].next; }
+                if (buckets[b].next != -1) { buckets[buckets[b].next].prev = buckets[b].prev; }
+                freeBuckets.push_back(b);
+            }
+        }
+    public:
+        LFU(FrameTable& frameTable) {
+            int frameNum = frameTable.size();
+            buckets.resize(frameNum + 1);  // A reference may create a bucket before its old one is dropped
+            for (int b = frameNum; b >= 0; b--) { freeBuckets.push_back(b); }
+            links.resize(frameNum);
+            bucketOf.assign(frameNum, -1);
+        }
+        int select_victim_frame() override {
+            int victimFrame = buckets[lowest].frames.front;
+            remove_frame(victimFrame);
+            return victimFrame;
+        }
+        void on_map(int frame) override {
+            int b = (lowest != -1 && buckets[lowest].count == 1) ? lowest : new_bucket(1, -1);
+            links.push_back(buckets[b].frames, frame);
+            bucketOf[frame] = b;
+        }
+        void on_unmap(int frame) override {
+            if (bucketOf[frame] != -1) { remove_frame(frame); }
+        }
+        void on_reference(int frame, bool faulted) override {
+            if (faulted) { return; }  // Counted as the first reference when the page was mapped
+            int b = bucketOf[frame];
+            long count = buckets[b].count + 1;
+            int next = buckets[b].next;
+            // Link the target bucket before the frame leaves b, b may be dropped when it becomes empty
+            int target = (next != -1 && buckets[next].count == count) ? next : new_bucket(count, b);
+            remove_frame(frame);
+            links.push_back(buckets[target].frames, frame);
+            bucketOf[frame] = target;
+        }
+        void save(SnapshotWriter& out) const override {
+            out.put(buckets);
+            out.put(freeBuckets);
+            out.put(lowest);
+            out.put(links);
+            out.put(bucketOf);
+        }
+        void load(SnapshotReader& in) override {
+            in.get(buckets);
+            in.get(freeBuckets);
+            in.get(lowest);
+            in.get(links);
+            in.get(bucketOf);
+        }
+};
 
 // Load random numbers into the vector (code from lab2)
 vector<int> loadRandNumbers(const string& randNumFile) {  // randNumFile: "rfile"
-    ifstream file(randNumFile);
-    if (!file.is_open()) {
+    vector<int> randvals;
+    FILE* file = fopen(randNumFile.c_str(), "rb");
+    if (!file) {
         cout << "Fail to open the random number file" << endl;
         exit(2);
     }
-    int currNumber;
-    if (!file >> currNumber) {
+    // Read the whole file at once and parse it in place
+    string text;
+    char chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) { text.append(chunk, n); }
+    fclose(file);
+    const char* p = text.c_str();
+    char* end;
+    // 1st number is the # of random numbers in the file (pass it)
+    long randNumCnt = strtol(p, &end, 10);
+    if (end == p) {
         cout << "Empty random number file" << endl;    
+        return randvals;
     }
-    // 1st number is the # of random numbers in the file (pass it)
-    file >> randNumCnt;
+    p = end;
     // Add all the random numbers to the vector
-    for (int i = 0; i < randNumCnt; i++) {
-        file >> currNumber;
+    randvals.reserve(max(randNumCnt, 0L));
+    for (long i = 0; i < randNumCnt; i++) {
+        long currNumber = strtol(p, &end, 10);
+        if (end == p) { break; }  // Fewer numbers than announced
         randvals.push_back(currNumber);
+        p = end;
     }
-    // Close the file after loading all numbers to the vector
-    file.close();
     return randvals;
 }
 
-// Print -o"OPFS" (O done)
-// P
-void pageTable_printer(const vector<Process*>& processTable) {
-    for (vector<Process*>::const_iterator process = processTable.begin(); process != processTable.end(); process++) {
-        printf("PT[%d]: ", (*process)->processId);
-        // Print all pages from the page table of the process
-        for (int i = 0; i < pageTableSize; i++) {
-            // To access the pageTable of a Process object pointed to by the iterator is to first dereference the iterator to get the Process pointer and then use -> to access the pageTable
-            Pte_t& pte = (*process)->pageTable[i];  
-            if (pte.PRESENT) {
-                // pte_t_size++;
-                printf("%d:", i); // Page number
-                if (workingSet) {
-                    printf(pte.PRE_REFERENCED ? "R" : "-");
+// Size of the chunks in which buffered output is written
+constexpr size_t outputChunkSize = 1 << 16;
+
+// Large output buffer in front of a file. Full chunks are written directly, or handed to a background writer
+// thread when async is set so that the simulation never waits on the file.
+class OutputBuffer {
+    public:
+        OutputBuffer(FILE* out, bool async, bool ownsFile = false): out(out), async(async), ownsFile(ownsFile) {
+            chunk.resize(outputChunkSize);
+            if (async) { writer = thread(&OutputBuffer::drain, this); }
+        }
+        ~OutputBuffer() {
+            flush();
+            if (async) {
+                {
+                    lock_guard<mutex> lock(m);
+                    done = true;
+                }
+                ready.notify_one();
+                writer.join();
+            }
+            if (ownsFile) { fclose(out); }
+        }
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+        void write(const char* data, size_t n) {
+            if (used + n > chunk.size()) { submit(); }
+            memcpy(&chunk[used], data, n);
+            used += n;
+        }
+        // Write out everything buffered so far (before anything else is printed to the same file)
+        void flush() {
+            submit();
+            if (async) {
+                unique_lock<mutex> lock(m);
+                idle.wait(lock, [this] { return pending.empty() && !writing; });
+            }
+            fflush(out);
+        }
+
+    private:
+        FILE* out;
+        bool async;
+        bool ownsFile;  // Close the file when done
+        vector<char> chunk;  // Chunk being filled
+        size_t used = 0;
+        // Background writer
+        thread writer;
+        mutex m;
+        condition_variable ready, idle;
+        deque<vector<char>> pending;  // Full chunks waiting to be written
+        bool writing = false;
+        bool done = false;
+
+        void submit() {
+            if (used == 0) { return; }
+            if (!async) {
+                fwrite(chunk.data(), 1, used, out);
+                used = 0;
+                return;
+            }
+            chunk.resize(used);
+            {
+                lock_guard<mutex> lock(m);
+                pending.push_back(move(chunk));
+            }
+            ready.notify_one();
+            chunk = vector<char>(outputChunkSize);
+            used = 0;
+        }
+        void drain() {
+            unique_lock<mutex> lock(m);
+            while (true) {
+                ready.wait(lock, [this] { return !pending.empty() || done; });
+                if (pending.empty()) { return; }
+                vector<char> data = move(pending.front());
+                pending.pop_front();
+                writing = true;
+                lock.unlock();
+                fwrite(data.data(), 1, data.size(), out);
+                lock.lock();
+                writing = false;
+                if (pending.empty()) { idle.notify_all(); }
+            }
+        }
+};
+
+// Trace output of a run: the -oO event lines and the EXIT lines
+enum EventType: uint8_t {EV_INSTR, EV_UNMAP, EV_OUT, EV_IN, EV_FOUT, EV_FIN, EV_ZERO, EV_MAP, EV_SEGV, EV_SEGPROT, EV_EXIT,
+                         EV_PREFETCH, EV_WRITEBACK, EV_ZOUT, EV_ZIN, EV_COPY, EV_MIGRATE, EV_SUSPEND, EV_RESUME, EV_LAST = EV_RESUME};
+struct Event {
+    EventType type;
+    int a;  // INSTR: instruction index, UNMAP/EXIT/PREFETCH/WRITEBACK/MIGRATE/SUSPEND/RESUME: pid, MAP: frame
+    int b;  // INSTR/UNMAP/PREFETCH/WRITEBACK/MIGRATE: vpage
+    char operation;  // INSTR: c, r, w, e
+    Event(EventType type, int a = 0, int b = 0, char operation = 0): type(type), a(a), b(b), operation(operation) {}
+};
+
+// Append the decimal digits of n
+void append_int(char*& p, int n) {
+    char digits[12];
+    int len = 0;
+    unsigned u = n < 0 ? 0u - (unsigned)n : (unsigned)n;
+    do {
+        digits[len++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (n < 0) { *p++ = '-'; }
+    while (len) { *p++ = digits[--len]; }
+}
+void append_str(char*& p, const char* s) {
+    while (*s) { *p++ = *s++; }
+}
+
+// Format the text line of an event into line (at least 64 bytes), return its length
+size_t format_event(const Event& e, char* line) {
+    char* p = line;
+    switch (e.type) {
+        case EV_INSTR:
+            append_int(p, e.a);
+            append_str(p, ": ==> ");
+            *p++ = e.operation;
+            *p++ = ' ';
+            append_int(p, e.b);
+            break;
+        case EV_UNMAP:
+            append_str(p, " UNMAP ");
+            append_int(p, e.a);
+            *p++ = ':';
+            append_int(p, e.b);
+            break;
+        case EV_OUT: append_str(p, " OUT"); break;
+        case EV_IN: append_str(p, " IN"); break;
+        case EV_FOUT: append_str(p, " FOUT"); break;
+        case EV_FIN: append_str(p, " FIN"); break;
+        case EV_ZERO: append_str(p, " ZERO"); break;
+        case EV_ZOUT: append_str(p, " ZOUT"); break;
+        case EV_ZIN: append_str(p, " ZIN"); break;
+        case EV_COPY: append_str(p, " COPY"); break;
+        case EV_MAP:
+            append_str(p, " MAP ");
+            append_int(p, e.a);
+            break;
+        case EV_SEGV: append_str(p, " SEGV"); break;
+        case EV_SEGPROT: append_str(p, " SEGPROT"); break;
+        case EV_EXIT:
+            append_str(p, "EXIT current process ");
+            append_int(p, e.a);
+            break;
+        case EV_PREFETCH:
+            append_str(p, " PREFETCH ");
+            append_int(p, e.a);
+            *p++ = ':';
+            append_int(p, e.b);
+            break;
+        case EV_WRITEBACK:
+            append_str(p, " WRITEBACK ");
+            append_int(p, e.a);
+            *p++ = ':';
+            append_int(p, e.b);
+            break;
+        case EV_MIGRATE:
+            append_str(p, " MIGRATE ");
+            append_int(p, e.a);
+            *p++ = ':';
+            append_int(p, e.b);
+            break;
+        case EV_SUSPEND:
+            append_str(p, " SUSPEND ");
+            append_int(p, e.a);
+            break;
+        case EV_RESUME:
+            append_str(p, " RESUME ");
+            append_int(p, e.a);
+            break;
+    }
+    *p++ = '\n';
+    return p - line;
+}
+
+// Destination of the events of a run
+class EventWriter {
+    public:
+        virtual ~EventWriter() {}
+        virtual void emit(const Event& e) = 0;
+        virtual void flush() {}
+        virtual long position() { return 0; }  // Bytes written to a log file so far (for checkpoints)
+};
+
+// Discards all events (runs that print nothing)
+class NullEventWriter: public EventWriter {
+    public:
+        void emit(const Event& e) {}
+};
+
+// Writes the events as the text lines of -oO
+class TextEventWriter: public EventWriter {
+    public:
+        TextEventWriter(FILE* out, bool async): buffer(out, async) {}
+        void emit(const Event& e) {
+            char line[64];
+            buffer.write(line, format_event(e, line));
+        }
+        void flush() { buffer.flush(); }
+    private:
+        OutputBuffer buffer;
+};
+
+// Binary event log: a magic header then one record per event, a type byte followed by its fields as
+// zigzag varints (INSTR stores its operation byte and vpage, the index is implied by the record order)
+const char eventLogMagic[8] = {'M', 'M', 'U', 'E', 'V', 'T', '1', '\n'};
+class BinaryEventWriter: public EventWriter {
+    public:
+        // A log resumed from a checkpoint already has its header
+        BinaryEventWriter(FILE* file, bool async, bool resumed = false): file(file), buffer(file, async, true) {
+            if (!resumed) { buffer.write(eventLogMagic, sizeof(eventLogMagic)); }
+        }
+        void emit(const Event& e) {
+            char record[16];
+            char* p = record;
+            *p++ = e.type;
+            switch (e.type) {
+                case EV_INSTR:
+                    *p++ = e.operation;
+                    put_varint(p, e.b);
+                    break;
+                case EV_UNMAP:
+                case EV_PREFETCH:
+                case EV_WRITEBACK:
+                case EV_MIGRATE:
+                    put_varint(p, e.a);
+                    put_varint(p, e.b);
+                    break;
+                case EV_MAP:
+                case EV_EXIT:
+                case EV_SUSPEND:
+                case EV_RESUME:
+                    put_varint(p, e.a);
+                    break;
+                default:
+                    break;
+            }
+            buffer.write(record, p - record);
+        }
+        void flush() { buffer.flush(); }
+        long position() {
+            buffer.flush();
+            return ftell(file);
+        }
+    private:
+        FILE* file;
+        OutputBuffer buffer;
+        static void put_varint(char*& p, int n) {
+            uint32_t u = ((uint32_t)n << 1) ^ (uint32_t)(n >> 31);
+            while (u >= 0x80) {
+                *p++ = (char)(u | 0x80);
+                u >>= 7;
+            }
+            *p++ = (char)u;
+        }
+};
+
+bool get_varint(FILE* in, int& n) {
+    uint32_t u = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int c = getc(in);
+        if (c == EOF) { return false; }
+        u |= (uint32_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            n = (int)(u >> 1) ^ -(int)(u & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Decode a binary event log back into the exact text the run would have printed (--decode)
+int decode_event_log(const string& path) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) {
+        cout << "Fail to open the event log" << endl;
+        return 2;
+    }
+    char magic[sizeof(eventLogMagic)];
+    if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, eventLogMagic, sizeof(magic)) != 0) {
+        cout << "Not an event log" << endl;
+        fclose(in);
+        return 2;
+    }
+    TextEventWriter text(stdout, false);
+    int idx = 0;
+    bool ok = true;
+    int type;
+    while (ok && (type = getc(in)) != EOF) {
+        Event e((EventType)type);
+        switch (type) {
+            case EV_INSTR:
+                e.a = idx++;
+                e.operation = getc(in);
+                ok = get_varint(in, e.b);
+                break;
+            case EV_UNMAP:
+            case EV_PREFETCH:
+            case EV_WRITEBACK:
+            case EV_MIGRATE:
+                ok = get_varint(in, e.a) && get_varint(in, e.b);
+                break;
+            case EV_MAP:
+            case EV_EXIT:
+            case EV_SUSPEND:
+            case EV_RESUME:
+                ok = get_varint(in, e.a);
+                break;
+            default:
+                ok = type <= EV_LAST;
+                break;
+        }
+        if (ok) { text.emit(e); }
+    }
+    text.flush();
+    fclose(in);
+    if (!ok) {
+        cout << "Truncated or corrupt event log" << endl;
+        return 2;
+    }
+    return 0;
+}
+
+// Options of a simulation run
+struct SimOptions {
+    int numFrames = 0;  // Number of frames
+    char algo = '\0';  // Selected paging algorithm
+    int tau = 49;  // Working-set window of the working-set pager (-t)
+    // -oOPFS
+    bool O_flag = false;
+    bool P_flag = false;
+    bool F_flag = false;
+    bool S_flag = false;
+    bool quiet = false;  // Print nothing at all (sweep runs only report their totals)
+    string eventLog;  // Write the events to this binary log instead of printing them (--event-log)
+    bool asyncLog = false;  // Write the event output on a background thread (--async-log)
+    int tlbEntries = 0;  // TLB size, 0 for no TLB (--tlb=ENTRIES[:WAYS])
+    int tlbWays = 0;  // Associativity, equal to tlbEntries for a fully associative TLB
+    bool tlbAsid = false;  // Tag TLB entries with ASIDs instead of flushing on context switches (--tlb-asid)
+    int readahead = 0;  // Pages prefetched ahead of a sequential or strided fault stream, 0 for none (--readahead)
+    int pcpBatch = 8;  // Frames moved at once between the global free pool and a CPU's cache (--pcp-batch)
+    string checkpoint;  // Snapshot file, empty for no checkpoints (--checkpoint)
+    long checkpointEvery = 1000000;  // Instructions between snapshots (--checkpoint-every)
+    bool resume = false;  // Start from the snapshot instead of the beginning of the trace (--resume)
+    int writebackPages = 0;  // Dirty pages the writeback daemon cleans per run, 0 for no daemon (--writeback=PAGES[:PERIOD])
+    int writebackPeriod = 100;  // Instructions between runs of the writeback daemon
+    int dirtyWatermark = 0;  // The daemon only cleans while more than this percentage of the frames is dirty (--dirty-watermark)
+    int zswapPercent = 0;  // Percentage of the frames reserved for the compressed pool, 0 for none (--zswap=PERCENT[:RATIO])
+    double zswapRatio = 3.0;  // Compressed pages stored per reserved frame
+    int numaNodes = 1;  // NUMA nodes the frames are split into, 1 for a flat memory (--numa=NODES[:POLICY])
+    char numaPolicy = 'l';  // Allocation policy: l(ocal), i(nterleave) or p(referred)
+    int numaPreferred = 0;  // Node of the preferred policy
+    int numaMigrate = 0;  // Remote accesses to a page that migrate it to the home node, 0 for no migration (--numa-migrate)
+    int loadWindow = 0;  // Instructions between load-control checks (and working-set window), 0 for none (--load-control=WINDOW[:RATE])
+    int thrashRate = 20;  // Percentage of the r/w of a window that must fault for thrashing
+    string metrics;  // Time-series file, CSV or JSON lines (FILE.json), empty for no metrics (--metrics)
+    long metricsEvery = 1000;  // Instructions between metrics rows (--metrics-every)
+    InstrCost costs;  // Cost of each operation, the built-in ones unless a cost file is given (--costs)
+    bool genericLoop = false;  // Run the main loop that dispatches the pager calls and checks the options at runtime (--generic-loop)
+};
+
+const char checkpointMagic[8] = {'M', 'M', 'U', 'C', 'K', 'P', 'T', '1'};
+// Step of the FNV-1a hash over whole values, used to recognize the inputs of a snapshot
+uint64_t fnv_step(uint64_t hash, uint64_t value) { return (hash ^ value) * 0x100000001b3ULL; }
+
+// Largest stride (in pages) the readahead engine follows
+constexpr int readaheadMaxStride = 8;
+
+// Access stream of a process in one VMA, as seen by the readahead engine
+struct ReadaheadState {
+    int lastVpage = -1;  // Last faulting (or prefetch-hit) page
+    int stride = 0;  // Distance from the access before it
+};
+
+// One run of the MMU simulation: the processes, frames, pager and counters for a trace.
+// The trace and the random source are only read, so several simulations can share them and run concurrently.
+class Simulation {
+    public:
+        SimOptions opts;
+        const Trace& trace;
+        const RandomSource& randomSource;  // Random numbers of the Random pager
+        FILE* out;  // Where the text output (events and -oPFS) goes
+        vector<Process> processTable;  // All processes, by id
+        // Arenas: the page tables (pageTableSize entries per process), the stats and the VMAs of all processes.
+        // A forked child's VMAs are appended to the VMA arena.
+        vector<Pte_t> pageTableArena;
+        vector<pstats> statsArena;
+        vector<Vma> vmaArena;
+        Process* currProc = nullptr;  // Process Id of the current process switched to (current_process)
+        FrameTable frameTable;  // The frame table that stores all frames
+        deque<int> freeFrames;  // The deque to manage all free frames (by frame id)
+        Pager* pager = nullptr;
+        EventWriter* events = nullptr;  // Where the -oO and EXIT lines go
+        Tlb* tlb = nullptr;  // TLB of the current CPU, nullptr without --tlb
+        // Multi-CPU traces: each CPU runs its own process, has its own TLB and caches free frames taken from (and
+        // returned to) freeFrames in batches. With a single CPU, freeFrames is used directly.
+        int numCpus = 1;
+        int currCpu = 0;
+        vector<Process*> cpuProc;  // Process running on each CPU (currProc for currCpu)
+        vector<deque<int>> cpuFreeFrames;  // Free-frame cache of each CPU
+        vector<Tlb*> tlbs;  // TLB of each CPU, empty without --tlb
+        long pcpRefills = 0;  // Batches moved from freeFrames to a CPU cache
+        long pcpDrains = 0;  // Times the caches of all CPUs were drained because memory ran out
+        bool hugePages = false;  // Some VMA maps its pages in superpages
+        FrameBitset touchedBits;  // Frames referenced since they were mapped (superpage fragmentation)
+        vector<ReadaheadState> readaheadStates;  // Per VMA of the VMA arena
+        FrameBitset prefetchedBits;  // Frames holding prefetched pages that were not referenced yet
+        int prefetchHand = 0;  // Where the search for an unused prefetched frame to recycle starts
+        FrameBitset cleanedBits;  // Frames cleaned by the writeback daemon and not written since
+        int writebackHand = 0;  // Where the writeback daemon resumes its sweep
+        // Compressed pool (zswap): opts.zswapPercent of the frames hold zswapCapacity compressed pages instead of
+        // being mapped. Stored pages are kept in LRU order by page key.
+        int zswapFrames = 0;
+        int zswapCapacity = 0;
+        IdLinks zswapLinks;
+        IdList zswapLru;  // Least recently stored at the front
+        // Frames shared after a fork: besides its owner (frameTable.pid/vPage, the page the pager knows the frame
+        // by), a frame is mapped by the pages in its list of sharers (by page key)
+        IdLinks sharerLinks;
+        vector<IdList> sharers;
+        // NUMA: node n holds frames [n * size / nodes, (n + 1) * size / nodes), a process's home node is pid % nodes
+        int interleaveNext = 0;  // Node of the next interleaved allocation
+        vector<int> remoteRefs;  // Remote accesses to each frame since it was mapped (migration)
+        // Load control: every opts.loadWindow instructions the fault rate of the window and the working sets of the
+        // running processes (pages referenced within the window) are checked. When memory thrashes, the process with
+        // the largest resident set is swapped out and suspended: its instructions are held back until it is resumed
+        // (FIFO, once its working set fits again) and then replayed, each held-back slice starting with its
+        // context switch.
+        vector<int> lastRefTime;  // currentTime of the last r/w of each page (by page key), -1 for never
+        vector<bool> suspended;  // Per process
+        vector<int> suspendedSince;  // currentTime of the suspension
+        vector<int> suspendWs;  // Working set at the suspension
+        deque<int> suspendQueue;  // Suspended processes, the first suspended at the front
+        vector<deque<int>> deferred;  // Trace positions held back for each suspended process
+        deque<int> replay;  // Trace positions to run before reading the trace on
+        int deferredPid = -1;  // Suspended process whose slice is being read from the trace
+        int windowFaults = 0;  // Faults and r/w since the last check
+        int windowRefs = 0;
+        bool thrashing = false;  // Result of the last check
+        int activeWs = 0;  // Working sets of the running processes at the last check (and of those resumed since)
+        int baselinePermille = 0;  // Fault rate of the window of the last suspension
+        long thrashWindows = 0;  // Checks that found memory thrashing
+        long faultsAvoided = 0;  // Estimated: faults at the baseline rate minus the faults taken while processes were suspended
+        // Metrics: the log2 histograms of each process (in pstats) and a row per process every opts.metricsEvery
+        // instructions with the r/w and faults since the previous row, the resident pages and the cost so far.
+        // The reuse distances use lastRefTime as well.
+        FILE* metricsFile = nullptr;
+        bool metricsJson = false;  // JSON lines instead of CSV
+        vector<int> lastFaultTime;  // currentTime of the last fault of each process, -1 for none
+        vector<long> reportedRefs;  // Counters of each process at the last row
+        vector<long> reportedFaults;
+        long metricsOffset = 0;  // Size of the metrics file at the restored snapshot
+        size_t nextInstr = 0;  // Position of the next instruction in the trace
+        bool segv = false;  // Whether there's a segv error
+        int idx = 0;
+        int instrCounter = 0;  // Instructions since the last NRU daemon run
+        int currentTime = 0;  // Used to calculate TAU (by instructions)
+        bool workingSet = false;  // Whether the pager is working-set
+        // For the final summary (S flag)
+        long inst_count = 0;
+        long ctx_switches = 0;  
+        long process_exits = 0;
+        long totalRead = 0;
+        long totalWrite = 0;
+        long totalExit = 0;
+        size_t lastCheckpoint = 0;  // Trace position of the last snapshot written or restored
+        uint64_t inputHash = 0;  // Hash of the VMAs, the instructions and the random numbers (checkpoint runs only)
+        long eventLogOffset = 0;  // Size of the event log at the restored snapshot
+
+        // Why the trace cannot run with the options, an empty string if it can
+        static string check_config(const SimOptions& opts, const Trace& trace) {
+            int mappedFrames = opts.numFrames;
+            if (opts.zswapPercent > 0) {
+                int zswapFrames = max(1, opts.numFrames * opts.zswapPercent / 100);
+                if (zswapFrames >= opts.numFrames) { return "The compressed pool leaves no frames to map pages"; }
+                mappedFrames -= zswapFrames;
+            }
+            if (opts.numaNodes > mappedFrames) { return "Every NUMA node needs at least one frame"; }
+            if (opts.numaNodes > 1 && trace.numCpus > 1) { return "NUMA mode does not support multi-CPU traces"; }
+            if (opts.loadWindow > 0 && (trace.hasFork || trace.numCpus > 1)) {
+                return "Load control does not support multi-CPU or forking traces";
+            }
+            bool hugePages = false;
+            for (const Vma& vma: trace.vmas) { hugePages = hugePages || vma.pageOrder > 0; }
+            if (trace.hasFork && hugePages) { return "Fork is not supported with superpage VMAs"; }
+            return "";
+        }
+
+        Simulation(const SimOptions& options, const Trace& trace, const RandomSource& randomSource, FILE* out = stdout):
+        opts(options), trace(trace), randomSource(randomSource), out(out) {
+            string error = check_config(opts, trace);
+            if (!error.empty()) {
+                cout << error << endl;
+                exit(2);
+            }
+            int processNum = trace.vmaStarts.size() - 1;
+            processTable.resize(processNum);
+            pageTableArena.resize(processNum * pageTableSize);
+            statsArena.resize(processNum);
+            vmaArena = trace.vmas;
+            for (int p = 0; p < processNum; p++) {
+                Process& proc = processTable[p];
+                proc.processId = p;
+                proc.vmaStart = trace.vmaStarts[p];
+                proc.vmaNum = trace.vmaStarts[p + 1] - trace.vmaStarts[p];
+                proc.pageTable = &pageTableArena[p * pageTableSize];
+                proc.stats = &statsArena[p];
+            }
+            inst_count = trace.instructions.size();
+            if (opts.zswapPercent > 0) {
+                zswapFrames = max(1, opts.numFrames * opts.zswapPercent / 100);
+                zswapCapacity = (int)(zswapFrames * opts.zswapRatio);
+                zswapLinks.resize(processTable.size() * pageTableSize);
+            }
+            create_frames(opts.numFrames - zswapFrames);
+            pager = create_pager(opts.algo);
+            numCpus = trace.numCpus;
+            cpuProc.assign(numCpus, nullptr);
+            cpuFreeFrames.resize(numCpus);
+            if (opts.tlbEntries > 0) {
+                for (int c = 0; c < numCpus; c++) { tlbs.push_back(new Tlb(opts.tlbEntries, opts.tlbWays)); }
+                tlb = tlbs[0];
+            }
+            for (const Vma& vma: vmaArena) { hugePages = hugePages || vma.pageOrder > 0; }
+            touchedBits.resize(frameTable.size());
+            prefetchedBits.resize(frameTable.size());
+            cleanedBits.resize(frameTable.size());
+            sharerLinks.resize(processTable.size() * pageTableSize);
+            sharers.resize(frameTable.size());
+            remoteRefs.assign(frameTable.size(), 0);
+            if (!opts.checkpoint.empty()) { inputHash = input_hash(); }
+            if (opts.loadWindow > 0 || !opts.metrics.empty()) { lastRefTime.assign(processTable.size() * pageTableSize, -1); }
+            if (!opts.metrics.empty()) {
+                lastFaultTime.assign(processTable.size(), -1);
+                reportedRefs.assign(processTable.size(), 0);
+                reportedFaults.assign(processTable.size(), 0);
+            }
+            if (opts.loadWindow > 0) {
+                suspended.assign(processTable.size(), false);
+                suspendedSince.assign(processTable.size(), 0);
+                suspendWs.assign(processTable.size(), 0);
+                deferred.resize(processTable.size());
+            }
+            readaheadStates.resize(vmaArena.size());
+            if (opts.resume) { load_checkpoint(); }
+            events = create_event_writer();  // After the snapshot, which tells where a resumed event log ends
+            if (!opts.metrics.empty()) { open_metrics(); }
+        }
+        ~Simulation() {
+            delete pager;
+            delete events;
+            for (Tlb* cpuTlb: tlbs) { delete cpuTlb; }
+            if (metricsFile) { fclose(metricsFile); }
+        }
+        Simulation(const Simulation&) = delete;  // Owns its pager, and the processes point into its arenas
+        Simulation& operator=(const Simulation&) = delete;
+
+        // Initialize the pager (Default: FIFO)
+        Pager* create_pager(char algo) {
+            int numPageKeys = processTable.size() * pageTableSize;
+            switch (algo) {
+                case 'r': return new Random(frameTable, randomSource);
+                case 'c': return new Clock(frameTable);
+                case 'e': return new NRU(frameTable, instrCounter);
+                case 'a': return new Aging(frameTable);
+                case 'w': return new WorkingSet(frameTable, currentTime, opts.tau);
+                case 'x': return new ARC(frameTable, numPageKeys);
+                case 'p': return new ClockPro(frameTable, numPageKeys);
+                case 'l': return new LRU(frameTable);
+                case 'u': return new LFU(frameTable);
+                default: return new FIFO(frameTable);
+            }
+        }
+
+        // Open the metrics file: a resumed one is cut back to its size at the snapshot and continued, a new one starts
+        // with the CSV header
+        void open_metrics() {
+            size_t len = opts.metrics.size();
+            metricsJson = len >= 5 && opts.metrics.compare(len - 5, 5, ".json") == 0;
+            metricsFile = fopen(opts.metrics.c_str(), opts.resume ? "r+" : "w");
+            if (!metricsFile || (opts.resume && (ftruncate(fileno(metricsFile), metricsOffset) != 0
+                                                 || fseek(metricsFile, 0, SEEK_END) != 0))) {
+                cout << "Fail to open the metrics file" << endl;
+                exit(2);
+            }
+            if (!opts.resume && !metricsJson) { fprintf(metricsFile, "instr,pid,refs,faults,fault_rate,resident,cost\n"); }
+        }
+
+        // Initialize the event output: nothing for quiet runs, the binary log if requested, else text on out
+        EventWriter* create_event_writer() {
+            if (opts.quiet) { return new NullEventWriter(); }
+            if (!opts.eventLog.empty()) {
+                // A resumed log is cut back to its size at the snapshot and continued
+                FILE* file = fopen(opts.eventLog.c_str(), opts.resume ? "r+b" : "wb");
+                if (!file || (opts.resume && (ftruncate(fileno(file), eventLogOffset) != 0 || fseek(file, 0, SEEK_END) != 0))) {
+                    cout << "Fail to open the event log" << endl;
+                    exit(2);
+                }
+                return new BinaryEventWriter(file, opts.asyncLog, opts.resume);
+            }
+            return new TextEventWriter(out, opts.asyncLog);
+        }
+
+        // Initialize frameTable and freeFrames
+        void create_frames(int frameNum) {
+            for (int i = 0; i < frameNum; i++) {
+                frameTable.add_frame();  // Add frame to the table
+                freeFrames.push_back(i);
+            }
+        }
+
+        // Copy the R/M bits mirrored in the frame table back into the PTE mapped to the frame (through the reverse map)
+        void sync_pte_bits(int f) {
+            Pte_t& pte = processTable[frameTable.pid[f]].pageTable[frameTable.vPage[f]];
+            pte.REFERENCED = frameTable.referenced(f);
+            pte.MODIFIED = frameTable.modified(f);
+            if (frameTable.bits[f] & FRAME_PRE_REFERENCED) { pte.PRE_REFERENCED = 1; }
+        }
+
+        // Release a frame and return it to the free pool
+        void free_frame(int f) {
+            if (prefetchedBits.test(f)) {  // The prefetch was wasted
+                processTable[frameTable.pid[f]].stats->raWasted++;
+                prefetchedBits.reset(f);
+            }
+            cleanedBits.reset(f);
+            remoteRefs[f] = 0;
+            frameTable.pid[f] = -1;
+            frameTable.vPage[f] = -1;
+            frameTable.bits[f] = 0;
+            frameTable.referencedBits.reset(f);
+            frameTable.modifiedBits.reset(f);
+            if (numCpus == 1) {
+                freeFrames.push_back(f);
+                return;
+            }
+            // Freed into the cache of the current CPU, which returns a batch to the global pool once it grows too big
+            deque<int>& cache = cpuFreeFrames[currCpu];
+            cache.push_back(f);
+            if ((int)cache.size() > 2 * opts.pcpBatch) {
+                for (int i = 0; i < opts.pcpBatch; i++) {
+                    freeFrames.push_back(cache.front());
+                    cache.pop_front();
+                }
+            }
+        }
+
+        // The next free frame for the current CPU, -1 if memory is full. A CPU whose cache is empty refills it with
+        // a batch from the global pool; when that is empty as well, the caches of the other CPUs are drained into
+        // it first (pagers only select victims when no frame is free anywhere).
+        int next_free_frame() {
+            if (numCpus == 1) {
+                if (freeFrames.empty()) { return -1; }
+                if (opts.numaNodes > 1) {  // The first free frame of the node the policy picks, else of any node
+                    int node = alloc_node();
+                    for (int f: freeFrames) {
+                        if (node_of(f) == node) { return f; }
+                    }
+                }
+                return freeFrames.front();
+            }
+            deque<int>& cache = cpuFreeFrames[currCpu];
+            if (cache.empty() && freeFrames.empty()) {
+                bool drained = false;
+                for (deque<int>& other: cpuFreeFrames) {
+                    drained = drained || !other.empty();
+                    freeFrames.insert(freeFrames.end(), other.begin(), other.end());
+                    other.clear();
+                }
+                if (drained) { pcpDrains++; }
+            }
+            if (cache.empty() && !freeFrames.empty()) {
+                for (int i = 0; i < opts.pcpBatch && !freeFrames.empty(); i++) {
+                    cache.push_back(freeFrames.front());
+                    freeFrames.pop_front();
+                }
+                pcpRefills++;
+            }
+            return cache.empty() ? -1 : cache.front();
+        }
+
+        // NUMA placement
+        int node_of(int f) const { return f * opts.numaNodes / frameTable.size(); }
+        int home_node(const Process* proc) const { return proc->processId % opts.numaNodes; }
+        // Node the next frame is allocated on: the home node of the faulting process, the next node round-robin, or
+        // the preferred node
+        int alloc_node() const {
+            switch (opts.numaPolicy) {
+                case 'i': return interleaveNext;
+                case 'p': return opts.numaPreferred;
+                default: return home_node(currProc);
+            }
+        }
+        // Count a r/w as local or remote to the process's home node. With migration, a page accessed remotely
+        // opts.numaMigrate times moves to a free frame of the home node (if there is one; shared frames and
+        // superpages stay). Returns the frame of the page.
+        int numa_access(Process* proc, int vpage, int frame) {
+            int home = home_node(proc);
+            if (node_of(frame) == home) {
+                proc->stats->localAccesses++;
+                return frame;
+            }
+            proc->stats->remoteAccesses++;
+            if (opts.numaMigrate == 0 || ++remoteRefs[frame] < opts.numaMigrate) { return frame; }
+            if (frameTable.order[frame] > 0 || sharers[frame].size > 0) { return frame; }
+            for (int f: freeFrames) {
+                if (node_of(f) == home) {
+                    migrate_page(frame, f);
+                    return f;
+                }
+            }
+            return frame;
+        }
+        // Move the page mapped to frame "from" to the free frame "to" with its R/M state. The pager sees the page
+        // unmapped from one frame and mapped to the other.
+        void migrate_page(int from, int to) {
+            Process* proc = &processTable[frameTable.pid[from]];
+            int vpage = frameTable.vPage[from];
+            if (opts.O_flag) { events->emit(Event(EV_MIGRATE, proc->processId, vpage)); }
+            take_free_frame(to, false);
+            frameTable.bits[to] = frameTable.bits[from];
+            frameTable.pid[to] = frameTable.pid[from];
+            frameTable.vPage[to] = vpage;
+            frameTable.age[to] = frameTable.age[from];
+            if (frameTable.referenced(from)) { frameTable.referencedBits.set(to); }
+            if (frameTable.modified(from)) { frameTable.modifiedBits.set(to); }
+            if (touchedBits.test(from)) { touchedBits.set(to); }
+            if (cleanedBits.test(from)) { cleanedBits.set(to); }
+            pager->on_unmap(from);
+            free_frame(from);
+            proc->pageTable[vpage].FRAMENUMBER = to;
+            invalidate_tlbs(proc, vpage);
+            if (opts.O_flag) { events->emit(Event(EV_MAP, to)); }
+            proc->stats->migrations++;
+            pager->on_map(to);
+        }
+
+        // Invalidate the translation of an unmapped page in the TLB of every CPU
+        void invalidate_tlbs(Process* proc, int vpage) {
+            for (Tlb* cpuTlb: tlbs) {
+                if (cpuTlb->invalidate(proc->processId, vpage)) { proc->stats->tlbShootdowns++; }
+            }
+        }
+        // Unmapping a page of a process that runs on other CPUs interrupts each of them (a cross-CPU shootdown)
+        void remote_shootdown(Process* proc) {
+            for (int c = 0; c < numCpus; c++) {
+                if (c != currCpu && cpuProc[c] == proc) { proc->stats->remoteShootdowns++; }
+            }
+        }
+
+        // Address exiting processes
+        void exit_handler(Process* exitProc) {
+            events->emit(Event(EV_EXIT, exitProc->processId));
+            // Unmap all mapped pages of the process from frames
+            for (int i = 0; i < pageTableSize; i++) {
+                exitProc->pageTable[i].PAGEDOUT = 0;  // First reset the PAGEDOUT of all pages of the exit process
+                if (exitProc->pageTable[i].ZSWAPPED) {  // Its compressed copy is dropped as well
+                    zswapLinks.remove(zswapLru, page_key(exitProc->processId, i));
+                    exitProc->pageTable[i].ZSWAPPED = 0;
+                }
+                if (exitProc->pageTable[i].PRESENT) {
+                    int f = exitProc->pageTable[i].FRAMENUMBER;
+                    exitProc->pageTable[i].COW = 0;
+                    if (sharers[f].size > 0) {  // Other pages keep the frame
+                        leave_shared_frame(exitProc, i);
+                        continue;
+                    }
+                    if (frameTable.order[f] > 0) {  // i is the first page of the superpage
+                        unmap_superpage(f, true);
+                        continue;
+                    }
+                    sync_pte_bits(f);
+                    exitProc->pageTable[i].PRESENT = 0;
+                    if (opts.O_flag) { events->emit(Event(EV_UNMAP, exitProc->processId, i)); }
+                    invalidate_tlbs(exitProc, i);
+                    // If pte is modified/ dirty (written to) and filemapped, need to write it back to its file (If the process if not filemapped, no need to write back to swap space since the process is exiting)
+                    if (exitProc->pageTable[i].MODIFIED && exitProc->pageTable[i].FILE_MAPPED) {
+                        if (opts.O_flag) { events->emit(Event(EV_FOUT)); }
+                        exitProc->stats->fouts++;  // Update pstats
+                    }
+                    exitProc->stats->unmaps++;  // Need this line???
+                    // Free the frame mapped to this page of the exit process and add it back freeFrames
+                    pager->on_unmap(f);
+                    free_frame(f);
+                }
+            }
+        }
+
+        // Unmap a frame from a page (for instructions "r" and "w")
+        template <class P = Pager, bool Events = true>
+        void unmap_frame_page(int f) {
+            if (frameTable.order[f] > 0) {
+                unmap_superpage(f, false);
+                return;
+            }
+            Process* proc = &processTable[frameTable.pid[f]];  // Current process mapped to this frame
+            int vpage = frameTable.vPage[f];
+            Pte_t* pte = &proc->pageTable[vpage];  // Current page mapped to this frame
+            sync_pte_bits(f);
+            // The process is not exiting!
+            if (Events && opts.O_flag) { events->emit(Event(EV_UNMAP, proc->processId, vpage)); }
+            invalidate_tlbs(proc, vpage);
+            remote_shootdown(proc);
+                proc->stats->unmaps++;  // Update pstats
+            bool shared = sharers[f].size > 0;
+            while (sharers[f].size > 0) {  // Every page sharing the frame loses it (and shares its copy in swap)
+                int key = sharerLinks.pop_front(sharers[f]);
+                Process* sharer = &processTable[key / pageTableSize];
+                Pte_t& sharerPte = sharer->pageTable[key % pageTableSize];
+                if (Events && opts.O_flag) { events->emit(Event(EV_UNMAP, sharer->processId, key % pageTableSize)); }
+                invalidate_tlbs(sharer, key % pageTableSize);
+                remote_shootdown(sharer);
+                sharer->stats->unmaps++;
+                if (pte->MODIFIED && !pte->FILE_MAPPED) { sharerPte.PAGEDOUT = 1; }
+                sharerPte.PRESENT = 0;
+                sharerPte.COW = 0;
+            }
+            pte->COW = 0;
+
+            if (pte->MODIFIED) {  // It pte is modified/ dirty -> go to swap space (OUT) or the mappedfile (FOUT)
+                if (pte->FILE_MAPPED) {  // Go to its mappedfile
+                    if (Events && opts.O_flag) { events->emit(Event(EV_FOUT)); }
+                    proc->stats->fouts++;  // Update pstats
+                } else if (zswapCapacity > 0 && !shared) {  // Go to the compressed pool (which holds one copy per page)
+                    zswap_store(proc, vpage);
+                } else {  // Go to swap space
+                    if (Events && opts.O_flag) { events->emit(Event(EV_OUT)); }
+                    proc->stats->outs++;  // Update pstats
+                    pte->PAGEDOUT = 1;  // The page is swapped out
+                }
+                pte->MODIFIED = 0;  // Reset the MODIFIED flag
+            // If the page is not modified before, unmap the page and the frame directly
+            } 
+            static_cast<P*>(pager)->on_unmap(f);
+            free_frame(f);  // The used frame has to be returned to the free pool 
+            pte->PRESENT = 0;  // The page now doesn't present in any frame 
+        }
+
+        // An exiting page gives up a frame that other pages still map. When it owned the frame, the first sharer
+        // becomes the owner: the pager sees the frame unmapped and mapped again under the new owner.
+        void leave_shared_frame(Process* proc, int vpage) {
+            Pte_t& pte = proc->pageTable[vpage];
+            int f = pte.FRAMENUMBER;
+            pte.PRESENT = 0;
+            if (opts.O_flag) { events->emit(Event(EV_UNMAP, proc->processId, vpage)); }
+            invalidate_tlbs(proc, vpage);
+            proc->stats->unmaps++;
+            if (frameTable.pid[f] != proc->processId || frameTable.vPage[f] != vpage) {
+                sharerLinks.remove(sharers[f], page_key(proc->processId, vpage));
+                return;
+            }
+            int key = sharerLinks.pop_front(sharers[f]);
+            pager->on_unmap(f);
+            frameTable.pid[f] = key / pageTableSize;
+            frameTable.vPage[f] = key % pageTableSize;
+            pager->on_fault(frameTable.pid[f], frameTable.vPage[f]);
+            pager->on_map(f);
+        }
+
+        // Fork: the child gets the VMAs of the parent and shares all its resident frames. Anonymous writable pages
+        // become copy-on-write in both, file-mapped and write-protected pages simply stay shared. The child's
+        // non-resident pages come back from swap (also those in the compressed pool, which keeps one copy per page).
+        void fork_handler(Process* parent, Process* child) {
+            child->vmaStart = vmaArena.size();
+            child->vmaNum = parent->vmaNum;
+            for (int v = 0; v < parent->vmaNum; v++) {
+                Vma vma = vmaArena[parent->vmaStart + v];  // Copied first, the arena may grow
+                vmaArena.push_back(vma);
+            }
+            readaheadStates.resize(vmaArena.size());
+            parent->stats->forks++;
+            for (int i = 0; i < pageTableSize; i++) {
+                Pte_t& pte = parent->pageTable[i];
+                Pte_t& childPte = child->pageTable[i];
+                childPte = Pte_t();
+                childPte.VALID_VMA = pte.VALID_VMA;
+                childPte.FILE_MAPPED = pte.FILE_MAPPED;
+                childPte.WRITE_PROTECT = pte.WRITE_PROTECT;
+                childPte.PAGEDOUT = pte.PAGEDOUT || pte.ZSWAPPED;
+                if (!pte.PRESENT) { continue; }
+                childPte.PRESENT = 1;
+                childPte.FRAMENUMBER = pte.FRAMENUMBER;
+                if (!pte.FILE_MAPPED && !pte.WRITE_PROTECT) {
+                    pte.COW = 1;
+                    childPte.COW = 1;
+                }
+                sharerLinks.push_back(sharers[pte.FRAMENUMBER], page_key(child->processId, i));
+            }
+        }
+
+        // A write to a copy-on-write page. A frame that other pages still share is copied: the owner of the frame
+        // keeps it and the sharers move to the copy (so the owner of a resident frame never changes under the pager),
+        // any other writer moves to the copy alone. Returns whether the written page got a new frame.
+        bool cow_fault(Process* proc, int vpage) {
+            Pte_t* pte = &proc->pageTable[vpage];
+            int f = pte->FRAMENUMBER;
+            proc->stats->cowFaults++;
+            pte->COW = 0;
+            if (sharers[f].size == 0) { return false; }  // The last page mapping the frame keeps it
+            int key = page_key(proc->processId, vpage);
+            bool owner = page_key(frameTable.pid[f], frameTable.vPage[f]) == key;
+            int copyOwner = owner ? sharers[f].front : key;
+            pager->on_fault(copyOwner / pageTableSize, copyOwner % pageTableSize);
+            int copy = get_frame();
+            if (frameTable.inUse(copy)) { unmap_frame_page(copy); }
+            if (!pte->PRESENT) {  // The shared frame itself was evicted: the page comes back privately
+                // The pager was told about the fault of the page the copy was meant for; an evicted owner is a new
+                // fault (the pager may hold it as a ghost by now)
+                if (copyOwner != key) { pager->on_fault(proc->processId, vpage); }
+                map_frame_page(copy, proc, vpage);
+                return true;
+            }
+            if (opts.O_flag) { events->emit(Event(EV_COPY)); }
+            proc->stats->cowCopies++;
+            take_free_frame(copy);
+            frameTable.bits[copy] = FRAME_IN_USE;
+            frameTable.pid[copy] = copyOwner / pageTableSize;
+            frameTable.vPage[copy] = copyOwner % pageTableSize;
+            frameTable.age[copy] = 0;
+            if (frameTable.modified(f)) { frameTable.modifiedBits.set(copy); }  // The copy is no cleaner than the original
+            touchedBits.reset(copy);
+            if (owner) {
+                sharerLinks.pop_front(sharers[f]);
+                while (sharers[f].size > 0) { sharerLinks.push_back(sharers[copy], sharerLinks.pop_front(sharers[f])); }
+            } else {
+                sharerLinks.remove(sharers[f], key);
+            }
+            move_page(copyOwner, copy);
+            for (int k = sharers[copy].front; k != -1; k = sharerLinks.next[k]) { move_page(k, copy); }
+            if (opts.O_flag) { events->emit(Event(EV_MAP, copy)); }
+            proc->stats->maps++;
+            pager->on_map(copy);
+            return !owner;
+        }
+        // Point the resident page (by page key) to another frame
+        void move_page(int key, int f) {
+            Process* proc = &processTable[key / pageTableSize];
+            proc->pageTable[key % pageTableSize].FRAMENUMBER = f;
+            invalidate_tlbs(proc, key % pageTableSize);
+        }
+
+        // Compress an evicted dirty anonymous page into the pool. A full pool first writes its least recently stored
+        // page out to swap.
+        void zswap_store(Process* proc, int vpage) {
+            if (zswapLru.size == zswapCapacity) {
+                int key = zswapLinks.pop_front(zswapLru);
+                Process* owner = &processTable[key / pageTableSize];
+                Pte_t& ownerPte = owner->pageTable[key % pageTableSize];
+                ownerPte.ZSWAPPED = 0;
+                ownerPte.PAGEDOUT = 1;
+                if (opts.O_flag) { events->emit(Event(EV_OUT)); }
+                owner->stats->outs++;
+                owner->stats->zswapWritebacks++;
+            }
+            zswapLinks.push_back(zswapLru, page_key(proc->processId, vpage));
+            proc->pageTable[vpage].ZSWAPPED = 1;
+            if (opts.O_flag) { events->emit(Event(EV_ZOUT)); }
+            proc->stats->zouts++;
+        }
+
+        // Unmap the superpage mapped to frame f as a unit: one UNMAP (and one OUT/FOUT if any of its pages is dirty)
+        void unmap_superpage(int f, bool exiting) {
+            int order = frameTable.order[f];
+            int head = f >> order << order;
+            int pageNum = 1 << order;
+            Process* proc = &processTable[frameTable.pid[head]];
+            int baseVpage = frameTable.vPage[head];
+            bool modified = false;
+            for (int i = 0; i < pageNum; i++) {
+                sync_pte_bits(head + i);
+                modified = modified || proc->pageTable[baseVpage + i].MODIFIED;
+                if (!touchedBits.test(head + i)) { proc->stats->hugeFrag++; }
+                invalidate_tlbs(proc, baseVpage + i);
+            }
+            remote_shootdown(proc);
+            if (opts.O_flag) { events->emit(Event(EV_UNMAP, proc->processId, baseVpage)); }
+            proc->stats->unmaps++;
+            bool pagedOut = false;
+            if (modified) {
+                if (proc->pageTable[baseVpage].FILE_MAPPED) {
+                    if (opts.O_flag) { events->emit(Event(EV_FOUT)); }
+                    proc->stats->fouts++;
+                } else if (!exiting) {  // An exiting process does not need its pages swapped out
+                    if (opts.O_flag) { events->emit(Event(EV_OUT)); }
+                    proc->stats->outs++;
+                    pagedOut = true;
+                }
+            }
+            for (int i = 0; i < pageNum; i++) {
+                Pte_t& pte = proc->pageTable[baseVpage + i];
+                if (pagedOut) { pte.PAGEDOUT = 1; }
+                pte.MODIFIED = 0;
+                pte.PRESENT = 0;
+                pager->on_unmap(head + i);
+                free_frame(head + i);
+                frameTable.order[head + i] = 0;
+            }
+        }
+
+        // Take a frame out of the free pool (normally its front). Allocations placed by the NUMA policy move the
+        // interleave cursor on; a migration has a fixed target node and leaves it alone.
+        void take_free_frame(int f, bool placed = true) {
+            if (placed && opts.numaPolicy == 'i') { interleaveNext = (interleaveNext + 1) % opts.numaNodes; }
+            if (numCpus == 1) {
+                remove_free_frame(freeFrames, f);
+                return;
+            }
+            // Normally from the cache of the current CPU, but superpage blocks may gather frames from every pool
+            if (remove_free_frame(cpuFreeFrames[currCpu], f) || remove_free_frame(freeFrames, f)) { return; }
+            for (deque<int>& cache: cpuFreeFrames) {
+                if (remove_free_frame(cache, f)) { return; }
+            }
+        }
+        // Remove a frame from a free pool, return whether it was there
+        bool remove_free_frame(deque<int>& pool, int f) {
+            if (!pool.empty() && pool.front() == f) {
+                pool.pop_front();
+                return true;
+            }
+            deque<int>::iterator it = find(pool.begin(), pool.end(), f);
+            if (it == pool.end()) { return false; }
+            pool.erase(it);
+            return true;
+        }
+
+        // Map a frame to a page
+        template <class P = Pager, bool Events = true>
+        void map_frame_page(int f, Process* proc, int vpage) {
+            Pte_t* pte = &proc->pageTable[vpage];
+            pte->PRESENT = 1;
+            pte->FRAMENUMBER = f;
+            bool zswapped = pte->ZSWAPPED;
+            if (pte->FILE_MAPPED) {
+                if (Events && opts.O_flag) { events->emit(Event(EV_FIN)); }  // If the page is filemapped, load data from file 
+                proc->stats->fins++;  // Update pstats
+            } else {
+                if (zswapped) {  // Decompressed from the pool, which drops its copy: the page is dirty again
+                    zswapLinks.remove(zswapLru, page_key(proc->processId, vpage));
+                    pte->ZSWAPPED = 0;
+                    pte->MODIFIED = 1;
+                    if (Events && opts.O_flag) { events->emit(Event(EV_ZIN)); }
+                    proc->stats->zins++;
+                } else if (pte->PAGEDOUT) {
+                    if (Events && opts.O_flag) { events->emit(Event(EV_IN)); }  // If the page is not filemapped and was move to the swap space ("OUT" before), load data from swap space to the frame again
+                    proc->stats->ins++;  // Update pstats
+                } else {  // The page was never swapped out and not filemapped
+                    if (Events && opts.O_flag) { events->emit(Event(EV_ZERO)); }
+                    proc->stats->zeros++;  // Update pstats
+                }
+            }
+            frameTable.bits[f] = FRAME_IN_USE;
+            frameTable.pid[f] = proc->processId;
+            frameTable.vPage[f] = vpage;
+            frameTable.age[f] = 0;
+            if (zswapped) { frameTable.modifiedBits.set(f); }
+            touchedBits.reset(f);
+            take_free_frame(f);
+            if (Events && opts.O_flag) { events->emit(Event(EV_MAP, f)); }
+            proc->stats->maps++;
+            static_cast<P*>(pager)->on_map(f);
+        }
+
+        // Map the superpage starting at baseVpage to the aligned frame block starting at head: one FIN/IN/ZERO and
+        // one MAP for the whole block
+        void map_superpage(int head, int order, Process* proc, int baseVpage) {
+            int pageNum = 1 << order;
+            const Pte_t& basePte = proc->pageTable[baseVpage];  // Every page of the superpage is in the same state
+            if (basePte.FILE_MAPPED) {
+                if (opts.O_flag) { events->emit(Event(EV_FIN)); }
+                proc->stats->fins++;
+            } else if (basePte.PAGEDOUT) {
+                if (opts.O_flag) { events->emit(Event(EV_IN)); }
+                proc->stats->ins++;
+            } else {
+                if (opts.O_flag) { events->emit(Event(EV_ZERO)); }
+                proc->stats->zeros++;
+            }
+            for (int i = 0; i < pageNum; i++) {
+                int f = head + i;
+                Pte_t& pte = proc->pageTable[baseVpage + i];
+                pte.PRESENT = 1;
+                pte.FRAMENUMBER = f;
+                frameTable.bits[f] = FRAME_IN_USE;
+                frameTable.pid[f] = proc->processId;
+                frameTable.vPage[f] = baseVpage + i;
+                frameTable.age[f] = 0;
+                frameTable.order[f] = order;
+                touchedBits.reset(f);
+                take_free_frame(f);
+            }
+            if (opts.O_flag) { events->emit(Event(EV_MAP, head)); }
+            proc->stats->maps++;
+            proc->stats->hugeMaps++;
+            for (int i = 0; i < pageNum; i++) {
+                if (i > 0) { pager->on_fault(proc->processId, baseVpage + i); }  // The pager saw the fault of the first page
+                pager->on_map(head + i);
+            }
+        }
+
+        // Readahead: an access stream that faults (or hits a prefetched page) twice in a row with the same stride
+        // in a VMA gets the next opts.readahead pages along the stride prefetched. Prefetches use free frames, else
+        // the frames of earlier prefetches that were never referenced, else the pager's victim (the page of least
+        // value to the pager). The window stops early when the pager picks a page prefetched in it.
+        void readahead(Process* proc, int vpage) {
+            int v = proc->vmaStart;
+            int vmaEnd = proc->vmaStart + proc->vmaNum;
+            while (v < vmaEnd && !(vpage >= vmaArena[v].startVpage && vpage <= vmaArena[v].endVpage)) { v++; }
+            if (v == vmaEnd || vmaArena[v].pageOrder > 0) { return; }  // Superpages are already prefetched
+            const Vma& vma = vmaArena[v];
+            ReadaheadState& state = readaheadStates[v];
+            int stride = state.lastVpage == -1 ? 0 : vpage - state.lastVpage;
+            bool streaming = stride != 0 && stride == state.stride && abs(stride) <= readaheadMaxStride;
+            state.lastVpage = vpage;
+            state.stride = stride;
+            if (!streaming) { return; }
+            // Prefetched frames that may be recycled: not the pages of this window
+            FrameBitset recyclable = prefetchedBits;
+            for (int i = 1; i <= opts.readahead; i++) {
+                int target = vpage + stride * i;
+                if (target < 0 || target >= pageTableSize) { break; }
+                if (proc->pageTable[target].PRESENT) { recyclable.reset(proc->pageTable[target].FRAMENUMBER); }
+            }
+            for (int i = 1; i <= opts.readahead; i++) {
+                int target = vpage + stride * i;
+                if (target < vma.startVpage || target > vma.endVpage) { break; }
+                Pte_t& pte = proc->pageTable[target];
+                if (pte.PRESENT) { continue; }
+                pager->on_fault(proc->processId, target);  // The pager sees the fault before it selects a victim
+                int f = prefetch_frame(recyclable);
+                bool ownPrefetch = prefetchedBits.test(f);  // The pager picked a page prefetched in this window
+                pte.VALID_VMA = 1;
+                pte.FILE_MAPPED = vma.fileMapped;
+                pte.WRITE_PROTECT = vma.writeProtected;
+                if (opts.O_flag) { events->emit(Event(EV_PREFETCH, proc->processId, target)); }
+                if (frameTable.inUse(f)) { unmap_frame_page(f); }
+                map_frame_page(f, proc, target);
+                prefetchedBits.set(f);
+                proc->stats->raIssued++;
+                if (ownPrefetch) { break; }
+            }
+        }
+        // Frame for a prefetch: the first free frame, else an unused prefetched frame of an earlier window, else
+        // the pager's victim
+        int prefetch_frame(FrameBitset& recyclable) {
+            int freeFrame = next_free_frame();
+            if (freeFrame != -1) { return freeFrame; }
+            int frameNum = frameTable.size();
+            int f = recyclable.find_next(prefetchHand, frameNum);
+            if (f == -1) { f = recyclable.find_next(0, prefetchHand); }
+            while (f != -1 && !prefetchedBits.test(f)) {  // Referenced since the window started
+                recyclable.reset(f);
+                f = recyclable.find_next(0, frameNum);
+            }
+            if (f == -1) { return pager->select_victim_frame(); }
+            recyclable.reset(f);
+            prefetchHand = (f + 1) % frameNum;
+            return f;
+        }
+
+        // Get an aligned block of 1 << order frames for a superpage, whose pages are all evicted: a free block, else
+        // the block with the fewest frames in use while memory is not full (pagers only select victims in full
+        // memory), else the block around the frame the pager selects. The victim is always evicted, even when it
+        // lies in the leftover frames after the last block (the pager already dropped it).
+        int get_frame_block(int order) {
+            int pageNum = 1 << order;
+            int blockNum = frameTable.size() >> order;
+            int head = -1;
+            int minUsed = pageNum + 1;
+            for (int block = 0; block < blockNum << order; block += pageNum) {
+                int used = 0;
+                for (int f = block; f < block + pageNum; f++) { used += frameTable.inUse(f); }
+                if (used < minUsed) {
+                    head = block;
+                    minUsed = used;
+                }
+            }
+            if (minUsed > 0 && next_free_frame() == -1) {
+                int victimFrame = pager->select_victim_frame();
+                if (victimFrame >> order < blockNum) { head = victimFrame >> order << order; }
+                unmap_frame_page(victimFrame);
+            }
+            for (int f = head; f < head + pageNum; f++) {
+                if (frameTable.inUse(f)) { unmap_frame_page(f); }
+            }
+            return head;
+        }
+
+        // Writeback daemon (page cleaner): every opts.writebackPeriod instructions, while more than opts.dirtyWatermark
+        // percent of the frames are dirty, write back up to opts.writebackPages dirty pages, sweeping the frames from
+        // where it stopped. Pages that were not referenced recently go first, as they are the likely next victims.
+        // A cleaned page stays mapped; its eviction is then a plain UNMAP (an anonymous page keeps its copy in swap).
+        void writeback_daemon() {
+            int frameNum = frameTable.size();
+            int cleaned = 0;
+            for (int pass = 0; pass < 2 && cleaned < opts.writebackPages; pass++) {
+                FrameBitset candidates = frameTable.modifiedBits;
+                if (pass == 0) {
+                    for (size_t w = 0; w < candidates.words.size(); w++) { candidates.words[w] &= ~frameTable.referencedBits.words[w]; }
+                }
+                while (cleaned < opts.writebackPages && frameTable.modifiedBits.count() * 100 > opts.dirtyWatermark * frameNum) {
+                    int f = candidates.find_next(writebackHand, frameNum);
+                    if (f == -1) { f = candidates.find_next(0, writebackHand); }
+                    if (f == -1) { break; }
+                    if (sharers[f].size > 0) {  // Dirtied before a fork: left to eviction, which updates every sharer
+                        candidates.reset(f);
+                        continue;
+                    }
+                    int order = frameTable.order[f];
+                    int head = f >> order << order;
+                    Process* proc = &processTable[frameTable.pid[head]];
+                    int baseVpage = frameTable.vPage[head];
+                    for (int g = head; g < head + (1 << order); g++) {  // A superpage is written back as a unit
+                        Pte_t& pte = proc->pageTable[frameTable.vPage[g]];
+                        pte.MODIFIED = 0;
+                        if (!pte.FILE_MAPPED) { pte.PAGEDOUT = 1; }
+                        frameTable.modifiedBits.reset(g);
+                        candidates.reset(g);
+                        cleanedBits.set(g);
+                    }
+                    if (opts.O_flag) { events->emit(Event(EV_WRITEBACK, proc->processId, baseVpage)); }
+                    proc->stats->bgWritebacks++;
+                    writebackHand = (head + (1 << order)) % frameNum;
+                    cleaned++;
+                }
+            }
+        }
+
+        // Set the R bit (and the M bit of writes) of the frame mapping a page and notify the pager. The frames of
+        // a superpage share one R and one M bit (they are all set).
+        template <class P = Pager>
+        void reference_frames(int frame, bool faulted) {
+            int order = frameTable.order[frame];
+            int head = frame >> order << order;
+            touchedBits.set(frame);
+            for (int f = head; f < head + (1 << order); f++) {
+                frameTable.referencedBits.set(f);
+                static_cast<P*>(pager)->on_reference(f, faulted);
+            }
+        }
+        void modify_frames(int frame) {
+            int order = frameTable.order[frame];
+            int head = frame >> order << order;
+            if (cleanedBits.test(head)) {  // The background writeback was in vain
+                processTable[frameTable.pid[head]].stats->redirtied++;
+                for (int f = head; f < head + (1 << order); f++) { cleanedBits.reset(f); }
+            }
+            for (int f = head; f < head + (1 << order); f++) { frameTable.modifiedBits.set(f); }
+        }
+
+        // Everything a snapshot must match: the trace and the options that change the state or the output
+        vector<long> checkpoint_signature() const {
+            return {opts.numFrames, opts.algo, opts.tau, (long)trace.instructions.size(), (long)processTable.size(), numCpus,
+                    opts.readahead, opts.tlbEntries, opts.tlbWays, opts.tlbAsid, opts.pcpBatch, randomSource.seeded,
+                    (long)randomSource.seed, (long)randomSource.values.size(), opts.O_flag, !opts.eventLog.empty(),
+                    opts.writebackPages, opts.writebackPeriod, opts.dirtyWatermark, opts.zswapPercent, (long)(opts.zswapRatio * 1000),
+                    opts.numaNodes, opts.numaPolicy, opts.numaPreferred, opts.numaMigrate, opts.loadWindow, opts.thrashRate,
+                    !opts.metrics.empty(), opts.metricsEvery, (long)inputHash};
+        }
+        uint64_t input_hash() const {
+            uint64_t hash = 0xcbf29ce484222325ULL;
+            for (const Vma& vma: trace.vmas) {
+                hash = fnv_step(hash, vma.startVpage);
+                hash = fnv_step(hash, vma.endVpage);
+                hash = fnv_step(hash, vma.writeProtected | vma.fileMapped << 1 | vma.pageOrder << 2);
+            }
+            for (int start: trace.vmaStarts) { hash = fnv_step(hash, start); }
+            for (const Instructions& instr: trace.instructions) {
+                hash = fnv_step(hash, instr.operation | (uint64_t)instr.cpu << 8 | (uint64_t)(uint32_t)instr.vpage << 32);
+            }
+            for (int value: randomSource.values) { hash = fnv_step(hash, (uint32_t)value); }
+            return hash;
+        }
+        int process_id(const Process* proc) const { return proc ? proc->processId : -1; }
+        Process* process_of(int pid) { return pid == -1 ? nullptr : &processTable[pid]; }
+
+        // Write the state at the current instruction boundary to opts.checkpoint. The snapshot is written to a
+        // temporary file first, so the previous one stays intact until the new one is complete.
+        void save_checkpoint() {
+            long logOffset = events->position();  // Also pushes out the events so far
+            events->flush();
+            string tmpPath = opts.checkpoint + ".tmp";
+            FILE* file = fopen(tmpPath.c_str(), "wb");
+            if (!file) {
+                cout << "Fail to open the checkpoint file" << endl;
+                exit(2);
+            }
+            SnapshotWriter out(file);
+            out.put(checkpointMagic);
+            out.put(checkpoint_signature());
+            out.put(logOffset);
+            out.put(nextInstr);
+            out.put(idx);
+            out.put(instrCounter);
+            out.put(currentTime);
+            out.put(ctx_switches);
+            out.put(process_exits);
+            out.put(totalRead);
+            out.put(totalWrite);
+            out.put(totalExit);
+            out.put(pageTableArena);
+            out.put(statsArena);
+            out.put(vmaArena);  // Grown by forks
+            for (const Process& proc: processTable) {
+                out.put(proc.vmaStart);
+                out.put(proc.vmaNum);
+                out.put(proc.exit);
+            }
+            out.put(frameTable.pid);
+            out.put(frameTable.vPage);
+            out.put(frameTable.age);
+            out.put(frameTable.time_last_used);
+            out.put(frameTable.bits);
+            out.put(frameTable.order);
+            out.put(frameTable.referencedBits);
+            out.put(frameTable.modifiedBits);
+            out.put(freeFrames);
+            out.put(process_id(currProc));
+            out.put(currCpu);
+            for (int c = 0; c < numCpus; c++) {
+                out.put(process_id(cpuProc[c]));
+                out.put(cpuFreeFrames[c]);
+            }
+            out.put(pcpRefills);
+            out.put(pcpDrains);
+            for (const Tlb* cpuTlb: tlbs) { cpuTlb->save(out); }
+            out.put(touchedBits);
+            out.put(readaheadStates);
+            out.put(prefetchedBits);
+            out.put(prefetchHand);
+            out.put(cleanedBits);
+            out.put(writebackHand);
+            out.put(zswapLinks);
+            out.put(zswapLru);
+            out.put(sharerLinks);
+            out.put(sharers);
+            out.put(interleaveNext);
+            out.put(remoteRefs);
+            out.put(lastRefTime);
+            out.put(suspended);
+            out.put(suspendedSince);
+            out.put(suspendWs);
+            out.put(suspendQueue);
+            for (const deque<int>& slices: deferred) { out.put(slices); }
+            out.put(replay);
+            out.put(deferredPid);
+            out.put(windowFaults);
+            out.put(windowRefs);
+            out.put(thrashing);
+            out.put(activeWs);
+            out.put(baselinePermille);
+            out.put(thrashWindows);
+            out.put(faultsAvoided);
+            out.put(lastFaultTime);
+            out.put(reportedRefs);
+            out.put(reportedFaults);
+            if (metricsFile) { fflush(metricsFile); }
+            out.put(metricsFile ? ftell(metricsFile) : 0L);
+            pager->save(out);
+            bool written = !ferror(file);
+            written = fclose(file) == 0 && written;
+            if (!written || rename(tmpPath.c_str(), opts.checkpoint.c_str()) != 0) {
+                cout << "Fail to write the checkpoint file" << endl;
+                exit(2);
+            }
+        }
+        // Restore the state written by save_checkpoint() (same order)
+        void load_checkpoint() {
+            FILE* file = fopen(opts.checkpoint.c_str(), "rb");
+            if (!file) {
+                cout << "Fail to open the checkpoint file" << endl;
+                exit(2);
+            }
+            SnapshotReader in(file);
+            char magic[sizeof(checkpointMagic)];
+            vector<long> signature;
+            in.get(magic);
+            in.get(signature);
+            if (!in.good() || memcmp(magic, checkpointMagic, sizeof(magic)) != 0 || signature != checkpoint_signature()) {
+                cout << "The checkpoint does not match this trace and options" << endl;
+                exit(2);
+            }
+            in.get(eventLogOffset);
+            in.get(nextInstr);
+            in.get(idx);
+            in.get(instrCounter);
+            in.get(currentTime);
+            in.get(ctx_switches);
+            in.get(process_exits);
+            in.get(totalRead);
+            in.get(totalWrite);
+            in.get(totalExit);
+            // The arenas keep their sizes (the signature matches the process count), only the VMA arena may have grown
+            in.get(pageTableArena);
+            in.get(statsArena);
+            in.get(vmaArena);
+            for (Process& proc: processTable) {
+                in.get(proc.vmaStart);
+                in.get(proc.vmaNum);
+                in.get(proc.exit);
+            }
+            in.get(frameTable.pid);
+            in.get(frameTable.vPage);
+            in.get(frameTable.age);
+            in.get(frameTable.time_last_used);
+            in.get(frameTable.bits);
+            in.get(frameTable.order);
+            in.get(frameTable.referencedBits);
+            in.get(frameTable.modifiedBits);
+            in.get(freeFrames);
+            int pid = -1;
+            in.get(pid);
+            currProc = process_of(pid);
+            in.get(currCpu);
+            for (int c = 0; c < numCpus; c++) {
+                in.get(pid);
+                cpuProc[c] = process_of(pid);
+                in.get(cpuFreeFrames[c]);
+            }
+            in.get(pcpRefills);
+            in.get(pcpDrains);
+            for (Tlb* cpuTlb: tlbs) { cpuTlb->load(in); }
+            tlb = tlbs.empty() ? nullptr : tlbs[currCpu];
+            in.get(touchedBits);
+            in.get(readaheadStates);
+            in.get(prefetchedBits);
+            in.get(prefetchHand);
+            in.get(cleanedBits);
+            in.get(writebackHand);
+            in.get(zswapLinks);
+            in.get(zswapLru);
+            in.get(sharerLinks);
+            in.get(sharers);
+            in.get(interleaveNext);
+            in.get(remoteRefs);
+            in.get(lastRefTime);
+            in.get(suspended);
+            in.get(suspendedSince);
+            in.get(suspendWs);
+            in.get(suspendQueue);
+            for (deque<int>& slices: deferred) { in.get(slices); }
+            in.get(replay);
+            in.get(deferredPid);
+            in.get(windowFaults);
+            in.get(windowRefs);
+            in.get(thrashing);
+            in.get(activeWs);
+            in.get(baselinePermille);
+            in.get(thrashWindows);
+            in.get(faultsAvoided);
+            in.get(lastFaultTime);
+            in.get(reportedRefs);
+            in.get(reportedFaults);
+            in.get(metricsOffset);
+            pager->load(in);
+            fclose(file);
+            if (!in.good()) {
+                cout << "Corrupt checkpoint file" << endl;
+                exit(2);
+            }
+            lastCheckpoint = nextInstr;
+        }
+
+        // Get the next instruction from the trace
+        bool get_next_instruction(char& operation, int& vpage, int& cpu) {
+            // Instruction boundaries are where snapshots are taken. Load control moves the trace position on by several
+            // instructions at a time, so a snapshot is due once the position has advanced far enough.
+            if (!opts.checkpoint.empty() && nextInstr - lastCheckpoint >= (size_t)opts.checkpointEvery) {
+                save_checkpoint();
+                lastCheckpoint = nextInstr;
+            }
+            if (opts.loadWindow > 0) {  // The trace order is changed by the suspended processes
+                int i = next_scheduled_instruction();
+                if (i == -1) { return false; }
+                const Instructions& currInstr = trace.instructions[i];
+                operation = currInstr.operation;
+                vpage = currInstr.vpage;
+                cpu = currInstr.cpu;
+                return true;
+            }
+            if (nextInstr < trace.instructions.size()) {
+                const Instructions& currInstr = trace.instructions[nextInstr++];  // Get the next instruction
+                operation = currInstr.operation;
+                vpage = currInstr.vpage;
+                cpu = currInstr.cpu;
+                return true;
+            }
+            return false;
+        }
+
+        // Load control: the trace position of the next instruction to run, -1 at the end. The slices of suspended
+        // processes are held back; at a context switch or exit the first suspended process is resumed if memory has
+        // room for its working set, and a suspended process that exits is resumed to finish first. What is still
+        // held back at the end of the trace runs then.
+        int next_scheduled_instruction() {
+            while (replay.empty()) {
+                if (nextInstr >= trace.instructions.size()) {
+                    if (suspendQueue.empty()) { return -1; }
+                    resume_process(&processTable[suspendQueue.front()]);
+                    continue;
+                }
+                int i = nextInstr++;
+                const Instructions& instr = trace.instructions[i];
+                if (instr.operation == 'c' || instr.operation == 'e') {
+                    deferredPid = -1;
+                    if (!suspendQueue.empty() && !thrashing
+                        && activeWs + suspendWs[suspendQueue.front()] <= frameTable.size()) {
+                        resume_process(&processTable[suspendQueue.front()]);
+                    }
+                    if (suspended[instr.vpage]) {
+                        if (instr.operation == 'c') {
+                            deferredPid = instr.vpage;
+                        } else {
+                            resume_process(&processTable[instr.vpage]);
+                        }
+                    }
+                }
+                if (deferredPid != -1) {
+                    deferred[deferredPid].push_back(i);
+                    processTable[deferredPid].stats->deferred++;
                 } else {
-                    printf(pte.REFERENCED ? "R" : "-");
+                    replay.push_back(i);
+                }
+            }
+            int i = replay.front();
+            replay.pop_front();
+            return i;
+        }
+
+        // Pages of the process referenced within the last opts.loadWindow instructions
+        int working_set_size(const Process* proc) const {
+            int size = 0;
+            for (int i = 0; i < pageTableSize; i++) {
+                int t = lastRefTime[page_key(proc->processId, i)];
+                size += t != -1 && currentTime - t < opts.loadWindow;
+            }
+            return size;
+        }
+
+        // Check for thrashing at the end of a window: too many of its r/w faulted while the working sets of the
+        // running processes do not fit in memory. Then suspend the running process with the largest resident set,
+        // other than the current one and the one the next instruction switches to (or exits). Nothing is suspended
+        // while held-back slices are being replayed, as the replay may switch to any process.
+        void load_control(const Process* next) {
+            activeWs = 0;
+            for (const Process& proc: processTable) {
+                if (!proc.exit && !suspended[proc.processId]) { activeWs += working_set_size(&proc); }
+            }
+            if (!suspendQueue.empty()) {
+                faultsAvoided += max(0L, (long)windowRefs * baselinePermille / 1000 - windowFaults);
+            }
+            thrashing = windowRefs > 0 && (long)windowFaults * 100 >= (long)windowRefs * opts.thrashRate
+                && activeWs > frameTable.size();
+            if (thrashing) { thrashWindows++; }
+            if (thrashing && replay.empty()) {
+                Process* victim = nullptr;
+                int victimResident = 0;
+                for (Process& proc: processTable) {
+                    if (&proc == currProc || &proc == next || proc.exit || suspended[proc.processId]) { continue; }
+                    int resident = 0;
+                    for (int i = 0; i < pageTableSize; i++) { resident += proc.pageTable[i].PRESENT; }
+                    if (resident > victimResident) {
+                        victim = &proc;
+                        victimResident = resident;
+                    }
+                }
+                if (victim) {
+                    baselinePermille = (long)windowFaults * 1000 / windowRefs;
+                    suspend_process(victim);
+                }
+            }
+            windowFaults = 0;
+            windowRefs = 0;
+        }
+
+        // Swap out all resident pages of the process and hold its instructions back
+        void suspend_process(Process* proc) {
+            int pid = proc->processId;
+            if (opts.O_flag) { events->emit(Event(EV_SUSPEND, pid)); }
+            suspendWs[pid] = working_set_size(proc);
+            activeWs -= suspendWs[pid];
+            for (int i = 0; i < pageTableSize; i++) {
+                if (proc->pageTable[i].PRESENT) { unmap_frame_page(proc->pageTable[i].FRAMENUMBER); }  // Whole superpages
+            }
+            suspended[pid] = true;
+            suspendedSince[pid] = currentTime;
+            suspendQueue.push_back(pid);
+            proc->stats->suspensions++;
+        }
+
+        // Let a suspended process run again: its held-back slices are replayed next, faulting its pages back in
+        void resume_process(Process* proc) {
+            int pid = proc->processId;
+            if (opts.O_flag) { events->emit(Event(EV_RESUME, pid)); }
+            suspended[pid] = false;
+            suspendQueue.erase(find(suspendQueue.begin(), suspendQueue.end(), pid));
+            proc->stats->suspendedTime += currentTime - suspendedSince[pid];
+            activeWs += suspendWs[pid];
+            replay.insert(replay.end(), deferred[pid].begin(), deferred[pid].end());
+            deferred[pid].clear();
+        }
+
+        // Bucket of a value >= 1 in the log2 histograms
+        static int log_bucket(long value) {
+            int b = 0;
+            while (value > 1 && b < histBuckets - 1) {
+                value >>= 1;
+                b++;
+            }
+            return b;
+        }
+        // Write a metrics row for every process
+        void export_metrics() {
+            for (const Process& proc: processTable) {
+                int pid = proc.processId;
+                long refs = proc.stats->refs - reportedRefs[pid];
+                long faults = proc.stats->faults - reportedFaults[pid];
+                reportedRefs[pid] = proc.stats->refs;
+                reportedFaults[pid] = proc.stats->faults;
+                int resident = 0;
+                for (int i = 0; i < pageTableSize; i++) { resident += proc.pageTable[i].PRESENT; }
+                double faultRate = refs > 0 ? (double)faults / refs : 0.0;
+                const char* format = metricsJson
+                    ? "{\"instr\":%d,\"pid\":%d,\"refs\":%ld,\"faults\":%ld,\"fault_rate\":%.4f,\"resident\":%d,\"cost\":%llu}\n"
+                    : "%d,%d,%ld,%ld,%.4f,%d,%llu\n";
+                fprintf(metricsFile, format, idx, pid, refs, faults, faultRate, resident, process_cost(*proc.stats));
+            }
+        }
+
+        // Get the next frame that should be mapped to the page after consulting the pagers
+        template <class P = Pager>
+        int get_frame() {
+            int frame = next_free_frame();  // Get the first (oldest) free frame
+            if (frame == -1) {  // There's no any free frame -> paging
+                frame = static_cast<P*>(pager)->select_victim_frame();
+            }
+            return frame;
+        }
+
+        // Handle page fault: If the page is valid (belongs to a VMA), allocate a frame to it
+        template <class P, bool Events>
+        void pagefault_handler(Pte_t* pte, int vpage) {
+            // If the page is not valid or not confirmed valid (belongs to a VMA) before, check it
+            if (!pte->VALID_VMA) {
+                for (int v = currProc->vmaStart; v < currProc->vmaStart + currProc->vmaNum; v++) {  // Check whether the page belongs to a VMA and record it 
+                    const Vma& vma = vmaArena[v];
+                    if (vpage >= vma.startVpage && vpage <= vma.endVpage) {
+                        pte->VALID_VMA = 1;
+                        // Also update the page's WRITE_PROTECT and FILE_MAPPED variables too since it's valid
+                        if (vma.fileMapped) { pte->FILE_MAPPED = 1; }
+                        if (vma.writeProtected) { pte->WRITE_PROTECT = 1; }
+                        // Superpages are only used for the aligned blocks that fit in the VMA (and in memory)
+                        int pageNum = 1 << vma.pageOrder;
+                        int baseVpage = vpage & ~(pageNum - 1);
+                        if (vma.pageOrder > 0 && baseVpage >= vma.startVpage && baseVpage + pageNum - 1 <= vma.endVpage
+                            && pageNum <= frameTable.size()) {
+                            pte->HUGE_ORDER = vma.pageOrder;
+                        }
+                        break;
+                    } 
+                }
+                // After checking and the page is not valid (doesn't belong to a VMA) -> a SEGV output line must be created
+                if (!pte->VALID_VMA) {  
+                    segv = true;
+                    return;  // The page is invalid, return directly
+                }
+            }
+            // If the page is (already) confirmed valid (belongs to a VMA) 
+            if (pte->HUGE_ORDER > 0) {  // Fault in the whole superpage
+                int order = pte->HUGE_ORDER;
+                int baseVpage = vpage >> order << order;
+                for (int i = 0; i < (1 << order); i++) {  // The pages of the block share the VMA of the faulting page
+                    Pte_t& blockPte = currProc->pageTable[baseVpage + i];
+                    blockPte.VALID_VMA = 1;
+                    blockPte.FILE_MAPPED = pte->FILE_MAPPED;
+                    blockPte.WRITE_PROTECT = pte->WRITE_PROTECT;
+                    blockPte.HUGE_ORDER = order;
                 }
-                
-                printf(pte.MODIFIED ? "M" : "-");
-                printf(pte.PAGEDOUT ? "S" : "-");
+                pager->on_fault(currProc->processId, baseVpage);
+                map_superpage(get_frame_block(order), order, currProc, baseVpage);
+                return;
+            }
+            static_cast<P*>(pager)->on_fault(currProc->processId, vpage);
+            int frame = get_frame<P>();  // Allocate or reclaim a frame
+            if (frameTable.inUse(frame)) {
+                unmap_frame_page<P, Events>(frame); 
+            }
+            map_frame_page<P, Events>(frame, currProc, vpage);
+            if (opts.readahead > 0) { readahead(currProc, vpage); }
+        }
+
+        // Simulation structure: execute all instructions of the trace. The loop is compiled for each pager (so the
+        // pager calls on the fault path are direct and inlined), with or without the event output and with or
+        // without the optional mechanisms; --generic-loop runs the version that decides all of it at runtime.
+        void run() {
+            if (opts.genericLoop) {
+                run_loop<Pager, true, true>();
+                return;
+            }
+            switch (opts.algo) {  // The pagers of create_pager()
+                case 'r': run_pager<Random>(); break;
+                case 'c': run_pager<Clock>(); break;
+                case 'e': run_pager<NRU>(); break;
+                case 'a': run_pager<Aging>(); break;
+                case 'w': run_pager<WorkingSet>(); break;
+                case 'x': run_pager<ARC>(); break;
+                case 'p': run_pager<ClockPro>(); break;
+                case 'l': run_pager<LRU>(); break;
+                case 'u': run_pager<LFU>(); break;
+                default: run_pager<FIFO>(); break;
+            }
+        }
+        template <class P>
+        void run_pager() {
+            // Any mechanism the main loop has to check for on every instruction
+            bool features = tlb || numCpus > 1 || opts.readahead > 0 || opts.writebackPages > 0 || opts.numaNodes > 1
+                || opts.loadWindow > 0 || trace.hasFork || metricsFile;
+            if (opts.O_flag) {
+                if (features) { run_loop<P, true, true>(); } else { run_loop<P, true, false>(); }
             } else {
-                printf(pte.PAGEDOUT ? "#" : "*");
+                if (features) { run_loop<P, false, true>(); } else { run_loop<P, false, false>(); }
+            }
+        }
+        template <class P, bool Events, bool Features>
+        void run_loop() {
+            char operation;
+            int vpage;
+            int cpu;
+            while (get_next_instruction(operation, vpage, cpu)) {
+                if (Features && cpu != currCpu) {  // Continue with the process (and TLB) of that CPU
+                    cpuProc[currCpu] = currProc;
+                    currCpu = cpu;
+                    currProc = cpuProc[cpu];
+                    if (tlb) { tlb = tlbs[cpu]; }
+                }
+                if (Events && opts.O_flag) { events->emit(Event(EV_INSTR, idx, vpage, operation)); }
+                idx++;
+                if (Features && opts.writebackPages > 0 && idx % opts.writebackPeriod == 0) { writeback_daemon(); }
+                if (Features && opts.loadWindow > 0 && idx % opts.loadWindow == 0) {
+                    load_control(operation == 'c' || operation == 'e' ? &processTable[vpage] : currProc);
+                }
+                if (Features && metricsFile && idx % opts.metricsEvery == 0) { export_metrics(); }
+                instrCounter++;  // Increase instrCounter by 1 for the daemon function
+                currentTime++;  // Increase currentTime by 1 
+                switch (operation) {
+                    case 'c':
+                        if (tlb && !opts.tlbAsid && currProc != &processTable[vpage]) { tlb->flush(); }
+                        currProc = &processTable[vpage];  
+                        cpuProc[currCpu] = currProc;
+                        ctx_switches++;
+                        break;
+                    case 'f':
+                        fork_handler(currProc, &processTable[vpage]);
+                        break;
+                    case 'e':
+                        currProc = &processTable[vpage];  // exiting process
+                        cpuProc[currCpu] = currProc;
+                        currProc->exit = true;
+                        process_exits++;
+                        totalExit++;
+                        exit_handler(currProc);
+                        break;
+                    default:
+                        Pte_t* pte = &currProc->pageTable[vpage];  // Get the correct page from pageTable in process
+                        bool faulted = !pte->PRESENT;
+                        bool tlbHit = false;  // Translations cached in the TLB are always of present pages
+                        if (Features && tlb) {
+                            tlbHit = tlb->lookup(currProc->processId, vpage);
+                            if (tlbHit) { currProc->stats->tlbHits++; } else { currProc->stats->tlbMisses++; }
+                        }
+                        if (!pte->PRESENT) {  // Handle page fault
+                            pagefault_handler<P, Events>(pte, vpage);  // Handle page fault error 
+                            if (segv) {  // If it's not valid, print error message and continue to the next instruction
+                                segv = false;
+                                if (Events && opts.O_flag) { events->emit(Event(EV_SEGV)); }
+                                currProc->stats->segv++;  // Update pstats
+                                if (operation == 'r') { totalRead++; }  // Also update totalRead and totalWrite
+                                if (operation == 'w') { totalWrite++; }
+                                continue;  // Print an SEGV error message and continue to the next instruction
+                            }
+                            if (Features && opts.loadWindow > 0) { windowFaults++; }
+                            if (Features && metricsFile) {
+                                int& lastFault = lastFaultTime[currProc->processId];
+                                if (lastFault != -1) { currProc->stats->faultGapHist[log_bucket(currentTime - lastFault)]++; }
+                                lastFault = currentTime;
+                                currProc->stats->faults++;
+                            }
+                        } 
+                        if (Features && !lastRefTime.empty()) {  // Load control or metrics: only valid pages count
+                            int& lastRef = lastRefTime[page_key(currProc->processId, vpage)];
+                            if (metricsFile) {
+                                if (lastRef != -1) { currProc->stats->reuseHist[log_bucket(currentTime - lastRef)]++; }
+                                currProc->stats->refs++;
+                            }
+                            lastRef = currentTime;
+                            windowRefs++;
+                        }
+                        if (Features && operation == 'w' && pte->COW) { faulted = cow_fault(currProc, vpage) || faulted; }
+                        if (Features && tlb && !tlbHit) { tlb->insert(currProc->processId, vpage); }  // The page walk fills the TLB
+                        if (Features && prefetchedBits.test(pte->FRAMENUMBER)) {  // First use of a prefetched page
+                            prefetchedBits.reset(pte->FRAMENUMBER);
+                            currProc->stats->raHits++;
+                            readahead(currProc, vpage);  // Keep the window ahead of the stream
+                        }
+                        // Update the PTE and mirror the R/M bits into the frame it is mapped to
+                        int frame = pte->FRAMENUMBER;
+                        if (Features && opts.numaNodes > 1) { frame = numa_access(currProc, vpage, frame); }
+                        if (operation == 'r') {
+                            pte->REFERENCED = 1;
+                            reference_frames<P>(frame, faulted);
+                            totalRead++;
+                        } else {  // operation == 'w'
+                            pte->REFERENCED = 1;
+                            reference_frames<P>(frame, faulted);
+                            if (pte->WRITE_PROTECT) {
+                                if (Events && opts.O_flag) { events->emit(Event(EV_SEGPROT)); }
+                                currProc->stats->segprot++;  // Update pstats
+                            } else {
+                                pte->MODIFIED = 1;  // The page is modified (written to)
+                                modify_frames(frame);
+                            }
+                            totalWrite++;
+                        }
+                }
+            }
+            if (Features && metricsFile && idx % opts.metricsEvery != 0) { export_metrics(); }  // The last partial period
+            events->flush();  // The P/F/S output is printed after all events
+        }
+
+        // Print -o"OPFS" (O done)
+        // P
+        void pageTable_printer() {
+            // Refresh the R/M bits of the resident pages from the frame table before printing them
+            for (int f = 0; f < frameTable.size(); f++) {
+                if (frameTable.inUse(f)) { sync_pte_bits(f); }
             }
-            // Only add a space if it's not the last page
-            if (i < pageTableSize - 1) {
-                printf(" ");
+            for (vector<Process>::const_iterator process = processTable.begin(); process != processTable.end(); process++) {
+                fprintf(out, "PT[%d]: ", process->processId);
+                // Print all pages from the page table of the process
+                for (int i = 0; i < pageTableSize; i++) {
+                    const Pte_t& pte = process->pageTable[i];
+                    if (pte.PRESENT) {
+                        fprintf(out, "%d:", i); // Page number
+                        if (workingSet) {
+                            fprintf(out, pte.PRE_REFERENCED ? "R" : "-");
+                        } else {
+                            fprintf(out, pte.REFERENCED ? "R" : "-");
+                        }
+                        
+                        fprintf(out, pte.MODIFIED ? "M" : "-");
+                        fprintf(out, pte.PAGEDOUT ? "S" : "-");
+                    } else {
+                        fprintf(out, pte.PAGEDOUT || pte.ZSWAPPED ? "#" : "*");
+                    }
+                    // Only add a space if it's not the last page
+                    if (i < pageTableSize - 1) {
+                        fprintf(out, " ");
+                    }
+                }
+                fprintf(out, "\n");
+            }
+        }
+        // F
+        void frameTable_printer() {
+            fprintf(out, "FT:");
+            for (int f = 0; f < frameTable.size(); f++) {
+                if (frameTable.inUse(f)) {
+                    fprintf(out, " %d:%d", frameTable.pid[f], frameTable.vPage[f]);
+                } else {
+                    fprintf(out, " *");
+                }
+            }
+            fprintf(out, "\n");
+        }
+        // Total cost of the run (TOTALCOST)
+        unsigned long long total_cost() const { return price(operation_counts(), opts.costs); }
+        // Cost of the paging work done for a process (everything but the r/w, exits and context switches)
+        unsigned long long process_cost(const pstats& stats) const { return price(process_counts(stats), opts.costs); }
+        // Count of each operation of the cost model in the run
+        InstrCost operation_counts() const {
+            InstrCost counts = zero_counts();
+            for (const Process& proc: processTable) {
+                InstrCost procCounts = process_counts(*proc.stats);
+                for (const CostField& op: costFields) { counts.*op.field += procCounts.*op.field; }
             }
+            counts.read = totalRead;
+            counts.write = totalWrite;
+            counts.exit = totalExit;
+            counts.ctx_switch = ctx_switches;
+            return counts;
+        }
+        InstrCost process_counts(const pstats& stats) const {
+            InstrCost counts = zero_counts();
+            counts.maps = stats.maps;
+            counts.unmaps = stats.unmaps;
+            counts.ins = stats.ins;
+            counts.outs = stats.outs;
+            counts.fins = stats.fins;
+            counts.fouts = stats.fouts;
+            counts.zeros = stats.zeros;
+            counts.segv = stats.segv;
+            counts.segprot = stats.segprot;
+            counts.tlb_miss = stats.tlbMisses;  // TLB counters stay 0 without --tlb
+            counts.tlb_shootdown = stats.tlbShootdowns;
+            counts.ipi_shootdown = stats.remoteShootdowns;
+            counts.bg_writeback = stats.bgWritebacks;
+            counts.zouts = stats.zouts;
+            counts.zins = stats.zins;
+            counts.forks = stats.forks;
+            counts.cow_faults = stats.cowFaults;
+            counts.cow_copies = stats.cowCopies;
+            counts.remote_access = stats.remoteAccesses;
+            counts.migrations = stats.migrations;
+            return counts;
+        }
+        // S
+        void summary_printer(const Process& proc) {
+            fprintf(out, "PROC[%d]: U=%lu M=%lu I=%lu O=%lu FI=%lu FO=%lu Z=%lu SV=%lu SP=%lu\n",
+                proc.processId,
+                proc.stats->unmaps, proc.stats->maps, proc.stats->ins, proc.stats->outs,
+                proc.stats->fins, proc.stats->fouts, proc.stats->zeros,
+                proc.stats->segv, proc.stats->segprot);
+            if (hugePages) {
+                fprintf(out, "HUGE[%d]: SP=%lu FRAG=%lu\n", proc.processId, proc.stats->hugeMaps, proc.stats->hugeFrag);
+            }
+            if (opts.readahead > 0) {
+                fprintf(out, "RA[%d]: ISSUED=%lu HIT=%lu WASTED=%lu\n", proc.processId, proc.stats->raIssued, proc.stats->raHits, proc.stats->raWasted);
+            }
+            if (tlb) {
+                fprintf(out, "TLB[%d]: H=%lu M=%lu SD=%lu\n", proc.processId, proc.stats->tlbHits, proc.stats->tlbMisses, proc.stats->tlbShootdowns);
+            }
+            if (numCpus > 1) {
+                fprintf(out, "SMP[%d]: RSD=%lu\n", proc.processId, proc.stats->remoteShootdowns);
+            }
+            if (opts.writebackPages > 0) {
+                fprintf(out, "WRITEBACK[%d]: BG=%lu SYNC=%lu REDIRTY=%lu\n", proc.processId, proc.stats->bgWritebacks,
+                    proc.stats->outs + proc.stats->fouts, proc.stats->redirtied);
+            }
+            if (trace.hasFork) {
+                int shared = 0;  // Resident pages whose frame is shared
+                for (int i = 0; i < pageTableSize; i++) {
+                    const Pte_t& pte = proc.pageTable[i];
+                    shared += pte.PRESENT && (sharers[pte.FRAMENUMBER].size > 0);
+                }
+                fprintf(out, "COW[%d]: FORKS=%lu FAULTS=%lu COPIES=%lu SHARED=%d\n", proc.processId, proc.stats->forks,
+                    proc.stats->cowFaults, proc.stats->cowCopies, shared);
+            }
+            if (opts.numaNodes > 1) {
+                fprintf(out, "NUMA[%d]: HOME=%d LOCAL=%lu REMOTE=%lu MIG=%lu\n", proc.processId, home_node(&proc),
+                    proc.stats->localAccesses, proc.stats->remoteAccesses, proc.stats->migrations);
+            }
+            if (opts.loadWindow > 0) {
+                fprintf(out, "LOAD[%d]: SUSP=%lu TIME=%lu DEFER=%lu\n", proc.processId, proc.stats->suspensions,
+                    proc.stats->suspendedTime, proc.stats->deferred);
+            }
+            if (metricsFile) {
+                print_histogram("REUSE", proc.processId, proc.stats->reuseHist);
+                print_histogram("FGAP", proc.processId, proc.stats->faultGapHist);
+            }
+            if (zswapCapacity > 0) {
+                // Cycles saved against swapping directly: every ZIN replaced an IN, every ZOUT an OUT unless the
+                // page was later written to swap anyway
+                const InstrCost& costs = opts.costs;
+                long long saved = proc.stats->zins * (costs.ins - costs.zins) + proc.stats->zouts * (costs.outs - costs.zouts)
+                    - proc.stats->zswapWritebacks * costs.outs;
+                fprintf(out, "ZSWAP[%d]: ZO=%lu ZI=%lu WB=%lu SAVED=%lld\n", proc.processId, proc.stats->zouts, proc.stats->zins,
+                    proc.stats->zswapWritebacks, saved);
+            }
+            
+            if (proc.processId == processTable.size() - 1) {
+                // inst_count, ctx_switches, process_exits, cost, sizeof(pte_t))
+                fprintf(out, "TOTALCOST %lu %lu %lu %llu %lu\n",
+                inst_count, ctx_switches, process_exits, total_cost(), sizeof(Pte_t));  // pte_t_size? 4? for the last field?
+                if (trace.hasFork) {
+                    // Memory footprint: frames in use against the resident pages they back
+                    int frames = 0, mappings = 0;
+                    for (int f = 0; f < frameTable.size(); f++) {
+                        if (frameTable.inUse(f)) {
+                            frames++;
+                            mappings += 1 + sharers[f].size;
+                        }
+                    }
+                    fprintf(out, "FORK FRAMES=%d MAPPINGS=%d SAVED=%d\n", frames, mappings, mappings - frames);
+                }
+                if (numCpus > 1) { fprintf(out, "CPUS %d REFILLS %lu DRAINS %lu\n", numCpus, pcpRefills, pcpDrains); }
+                if (opts.loadWindow > 0) { fprintf(out, "LOADCTL THRASH %lu AVOIDED %lu\n", thrashWindows, faultsAvoided); }
+            }
+        }
+        // A log2 histogram: the bounds below which half and 99% of the values are, then the count of each non-empty
+        // bucket by its lower bound
+        void print_histogram(const char* name, int pid, const long* hist) {
+            long total = 0;
+            for (int b = 0; b < histBuckets; b++) { total += hist[b]; }
+            fprintf(out, "%s[%d]: N=%ld", name, pid, total);
+            long seen = 0;
+            bool p50 = false, p99 = false;
+            for (int b = 0; b < histBuckets && total > 0; b++) {
+                seen += hist[b];
+                if (!p50 && seen * 2 >= total) {
+                    fprintf(out, " P50<%lu", 2ul << b);
+                    p50 = true;
+                }
+                if (!p99 && seen * 100 >= total * 99) {
+                    fprintf(out, " P99<%lu", 2ul << b);
+                    p99 = true;
+                }
+            }
+            for (int b = 0; b < histBuckets; b++) {
+                if (hist[b] > 0) { fprintf(out, " %lu:%ld", 1ul << b, hist[b]); }
+            }
+            fprintf(out, "\n");
+        }
+        void print_results() {
+            if (opts.P_flag) { pageTable_printer(); }
+            if (opts.F_flag) { frameTable_printer(); }
+            if (opts.S_flag) {
+                for (const Process& process: processTable) {
+                    summary_printer(process);
+                }
+            }
+        }
+};
+
+// Parse a list of frame counts: comma-separated numbers or ranges "first-last" / "first-last:step"
+vector<int> parse_frame_list(const string& list) {
+    vector<int> frameCounts;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        int first, last, step = 1;
+        char dash, colon;
+        istringstream iss(item);
+        if (!(iss >> first)) { continue; }
+        last = first;
+        if (iss >> dash && dash == '-') {
+            iss >> last;
+            if (iss >> colon && colon == ':') { iss >> step; }
+        }
+        for (int n = first; n <= last && step > 0; n += step) {
+            frameCounts.push_back(n);
         }
-        printf("\n");
     }
+    return frameCounts;
 }
-// F
-void frameTable_printer(const std::vector<Frame_t>& frameTable) {
-    printf("FT:");
-    for (const Frame_t& frame : frameTable) {
-        if (frame.inUse) {
-            printf(" %d:%d", frame.process->processId, frame.vPage);
-        } else {
-            printf(" *");
+
+// Sweep mode: simulate every (frame count, algorithm) configuration over the same trace on a pool of worker
+// threads. The trace is parsed once and shared; each configuration prints one TOTALCOST row in the given order.
+void run_sweep(const SimOptions& baseOptions, const Trace& trace, const RandomSource& randomSource,
+               const vector<int>& frameCounts, const string& algos, int jobs) {
+    vector<SimOptions> configs;
+    for (char algo: algos) {
+        for (int frames: frameCounts) {
+            SimOptions options = baseOptions;
+            options.numFrames = frames;
+            options.algo = algo;
+            options.O_flag = options.P_flag = options.F_flag = options.S_flag = false;
+            options.quiet = true;
+            configs.push_back(options);
         }
     }
-    printf("\n");
+    vector<string> rows(configs.size());
+    atomic<size_t> nextConfig(0);
+    auto worker = [&]() {
+        for (size_t i = nextConfig++; i < configs.size(); i = nextConfig++) {
+            Simulation sim(configs[i], trace, randomSource);
+            sim.run();
+            char row[160];
+            snprintf(row, sizeof(row), "FRAMES=%d ALGO=%c TOTALCOST %lu %lu %lu %llu %lu\n",
+                configs[i].numFrames, configs[i].algo, sim.inst_count, sim.ctx_switches, sim.process_exits,
+                sim.total_cost(), sizeof(Pte_t));
+            rows[i] = row;
+        }
+    };
+    vector<thread> pool;
+    for (int t = 0; t < jobs && t < (int)configs.size(); t++) {
+        pool.push_back(thread(worker));
+    }
+    for (thread& t: pool) { t.join(); }
+    for (const string& row: rows) { fputs(row.c_str(), stdout); }
+}
+
+// Best time of repeated runs of one configuration, with the counters of the last run
+struct BenchResult {
+    double seconds = 0;
+    long refs = 0;
+    long faults = 0;
+    unsigned long long cost = 0;
+};
+BenchResult bench_config(const SimOptions& options, const Trace& trace, const RandomSource& randomSource, int repeats) {
+    BenchResult result;
+    for (int r = 0; r < repeats; r++) {
+        Simulation sim(options, trace, randomSource);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        sim.run();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (r == 0 || seconds < result.seconds) { result.seconds = seconds; }
+        result.refs = sim.totalRead + sim.totalWrite;
+        result.faults = 0;
+        for (const Process& proc: sim.processTable) { result.faults += proc.stats->maps - proc.stats->raIssued; }
+        result.cost = sim.total_cost();
+    }
+    return result;
 }
-// S
-void summary_printer(const Process& proc) {
-    // inst_count, ctx_switches, process_exits, cost, sizeof(pte_t))
-    unsigned long long totalCost = 0;
-    InstrCost* costs = new InstrCost;
-    // Calculate the total count of each instruction for TOTALCOST
-    totalMaps += proc.stats->maps;
-    totalUnmaps += proc.stats->unmaps;
-    totalIns += proc.stats->ins;
-    totalOuts += proc.stats->outs;
-    totalFins += proc.stats->fins;
-    totalFouts += proc.stats->fouts;
-    totalZeros += proc.stats->zeros;
-    totalSegv += proc.stats->segv;
-    totalSegprot += proc.stats->segprot;
-    totalCost = totalCost + totalMaps*costs->maps + totalUnmaps*costs->unmaps + totalIns*costs->ins + totalOuts*costs->outs + totalFins*costs->fins 
-                + totalFouts*costs->fouts + totalZeros*costs->zeros + totalSegv*costs->segv + totalSegprot*costs->segprot + totalRead*costs->read +
-                totalWrite*costs->write + totalExit*costs->exit + ctx_switches*costs->ctx_switch;
-
-    printf("PROC[%d]: U=%lu M=%lu I=%lu O=%lu FI=%lu FO=%lu Z=%lu SV=%lu SP=%lu\n",
-        proc.processId,
-        proc.stats->unmaps, proc.stats->maps, proc.stats->ins, proc.stats->outs,
-        proc.stats->fins, proc.stats->fouts, proc.stats->zeros,
-        proc.stats->segv, proc.stats->segprot);
-    
-    if (proc.processId == processTable.size() - 1) {
-        printf("TOTALCOST %lu %lu %lu %llu %lu\n",
-        inst_count, ctx_switches, process_exits, totalCost, sizeof(Pte_t));  // pte_t_size? 4? for the last field?
+
+// Benchmark mode: simulate the trace with every given pager, one after the other on this thread, and report the
+// simulation speed (r/w per second of the best of the repeated runs) with the faults and the total cost, so the
+// speed and the quality of the pagers are tracked together. Each pager is also run with the generic main loop
+// (--generic-loop) to show what the loop compiled for the pager gains.
+void run_bench(const SimOptions& baseOptions, const Trace& trace, const RandomSource& randomSource,
+               const string& algos, int repeats) {
+    for (char algo: algos) {
+        SimOptions options = baseOptions;
+        options.algo = algo;
+        options.O_flag = options.P_flag = options.F_flag = options.S_flag = false;
+        options.quiet = true;
+        options.genericLoop = false;
+        BenchResult compiled = bench_config(options, trace, randomSource, repeats);
+        options.genericLoop = true;
+        BenchResult generic = bench_config(options, trace, randomSource, repeats);
+        double refsPerSec = compiled.seconds > 0 ? compiled.refs / compiled.seconds : 0.0;
+        double genericRefsPerSec = generic.seconds > 0 ? generic.refs / generic.seconds : 0.0;
+        printf("BENCH ALGO=%c FRAMES=%d REFS=%ld FAULTS=%ld SECONDS=%.6f REFS/SEC=%.0f GENERIC=%.0f SPEEDUP=%.2f TOTALCOST %llu\n",
+            algo, options.numFrames, compiled.refs, compiled.faults, compiled.seconds, refsPerSec, genericRefsPerSec,
+            genericRefsPerSec > 0 ? refsPerSec / genericRefsPerSec : 0.0, compiled.cost);
+    }
+}
+
+// Batch mode: replay every trace of the list file (one process file per line) with the same options on a pool of
+// worker threads, sharing the random numbers. Each trace is loaded by the worker that runs it. With an output
+// directory, the full output of the n-th trace of the list goes to DIR/<n>-<process file name>.out (so process
+// files of the same name in different directories do not collide). One row per trace is printed in list order: its
+// TOTALCOST line, or ERROR and the message if the trace cannot be read or run with the options.
+void run_batch(const SimOptions& baseOptions, const RandomSource& randomSource, const string& listFile,
+               const string& outputDir, int jobs) {
+    ifstream list(listFile);
+    if (!list.is_open()) {
+        cout << "Fail to open the batch list" << endl;
+        exit(2);
+    }
+    vector<string> traceFiles;
+    string line;
+    while (getline(list, line)) {
+        if (!line.empty() && line[0] != '#') { traceFiles.push_back(line); }
+    }
+    SimOptions options = baseOptions;
+    if (outputDir.empty()) {
+        options.O_flag = options.P_flag = options.F_flag = options.S_flag = false;
+        options.quiet = true;
+    }
+    vector<string> rows(traceFiles.size());
+    atomic<size_t> nextTrace(0);
+    auto worker = [&]() {
+        for (size_t i = nextTrace++; i < traceFiles.size(); i = nextTrace++) {
+            Trace trace;
+            string error = read_trace(traceFiles[i], trace);
+            if (error.empty()) { error = Simulation::check_config(options, trace); }
+            FILE* out = stdout;
+            if (error.empty() && !outputDir.empty()) {
+                string outFile = outputDir + "/" + to_string(i + 1) + "-"
+                               + traceFiles[i].substr(traceFiles[i].find_last_of('/') + 1) + ".out";
+                out = fopen(outFile.c_str(), "w");
+                if (!out) { error = "Fail to open the output file " + outFile; }
+            }
+            if (!error.empty()) {
+                rows[i] = "TRACE=" + traceFiles[i] + " ERROR " + error + "\n";
+                continue;
+            }
+            char row[PATH_MAX + 128];
+            {
+                Simulation sim(options, trace, randomSource, out);
+                sim.run();
+                sim.print_results();
+                snprintf(row, sizeof(row), "TRACE=%s TOTALCOST %lu %lu %lu %llu %lu\n", traceFiles[i].c_str(),
+                    sim.inst_count, sim.ctx_switches, sim.process_exits, sim.total_cost(), sizeof(Pte_t));
+            }
+            if (out != stdout) { fclose(out); }
+            rows[i] = row;
+        }
+    };
+    vector<thread> pool;
+    for (int t = 0; t < jobs && t < (int)traceFiles.size(); t++) {
+        pool.push_back(thread(worker));
+    }
+    for (thread& t: pool) { t.join(); }
+    for (const string& row: rows) { fputs(row.c_str(), stdout); }
+}
+
+// Fenwick (binary indexed) tree of counts over positions 1..n
+struct Fenwick {
+    vector<int> tree;
+    Fenwick(size_t n): tree(n + 1, 0) {}
+    void add(size_t pos, int delta) {
+        for (; pos < tree.size(); pos += pos & (~pos + 1)) { tree[pos] += delta; }
+    }
+    long sum(size_t pos) const {  // Sum over [1, pos]
+        long total = 0;
+        for (; pos > 0; pos -= pos & (~pos + 1)) { total += tree[pos]; }
+        return total;
+    }
+};
+
+// Hash used to sample page keys (64-bit finalizer of MurmurHash3)
+uint64_t hash_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// Miss-ratio curve mode: the LRU fault count of every frame count in one pass over the trace.
+// LRU is a stack algorithm: with n frames the resident pages are the top n entries of one recency stack, so a
+// reference hits iff its stack distance (its depth in the stack) is at most n. An exiting process leaves holes
+// where its pages were, standing for the frames it frees. A reference moving a page to the top from below a hole
+// (or faulting in a new page) only pushes the entries above the topmost such hole down: that hole is filled and
+// the page's old entry becomes a hole. The depth is counted with a Fenwick tree over reference times that marks the last
+// use of every stack entry, holes included.
+// With samplingRate < 1, only pages whose hash falls under the rate are tracked (SHARDS): their distances and
+// counts are scaled by 1/samplingRate, which estimates the curve of traces too large to process exactly.
+void run_mrc(const Trace& trace, const vector<int>& frameCounts, double samplingRate) {
+    int processNum = trace.vmaStarts.size() - 1;
+    int numPageKeys = processNum * pageTableSize;
+    // Pages that belong to a VMA (other references are SEGVs and never fault a page in)
+    vector<bool> validPage(numPageKeys, false);
+    for (int p = 0; p < processNum; p++) {
+        for (int v = trace.vmaStarts[p]; v < trace.vmaStarts[p + 1]; v++) {
+            const Vma& vma = trace.vmas[v];
+            for (int vpage = max(vma.startVpage, 0); vpage <= vma.endVpage && vpage < pageTableSize; vpage++) {
+                validPage[page_key(p, vpage)] = true;
+            }
+        }
+    }
+    uint64_t threshold = samplingRate >= 1.0 ? UINT64_MAX : (uint64_t)(samplingRate * (double)UINT64_MAX);
+    vector<bool> sampledPage(numPageKeys);
+    for (int key = 0; key < numPageKeys; key++) { sampledPage[key] = hash_key(key) <= threshold; }
+
+    Fenwick lastUse(trace.instructions.size());
+    vector<size_t> lastPos(numPageKeys, 0);  // Time of the last reference of each live page, 0 if not live
+    set<size_t> holes;  // Times of the stack entries of exited pages
+    vector<long> distanceCount(numPageKeys + 2, 0);  // Histogram of (unscaled) stack distances
+    long coldMisses = 0, references = 0, sampledReferences = 0;
+    size_t now = 0;
+    int currPid = 0;
+    for (const Instructions& instr: trace.instructions) {
+        if (instr.operation == 'c') {
+            currPid = instr.vpage;
+        } else if (instr.operation == 'e') {
+            for (int vpage = 0; vpage < pageTableSize; vpage++) {
+                int key = page_key(instr.vpage, vpage);
+                if (lastPos[key]) {
+                    holes.insert(lastPos[key]);
+                    lastPos[key] = 0;
+                }
+            }
+        } else if (instr.vpage >= 0 && instr.vpage < pageTableSize && validPage[page_key(currPid, instr.vpage)]) {
+            references++;
+            int key = page_key(currPid, instr.vpage);
+            if (!sampledPage[key]) { continue; }
+            sampledReferences++;
+            now++;
+            if (lastPos[key]) {
+                distanceCount[lastUse.sum(now - 1) - lastUse.sum(lastPos[key]) + 1]++;
+            } else {
+                coldMisses++;
+            }
+            if (!holes.empty() && *holes.rbegin() > lastPos[key]) {
+                // The topmost hole above the page is filled and the page's old entry becomes a hole
+                lastUse.add(*holes.rbegin(), -1);
+                holes.erase(prev(holes.end()));
+                if (lastPos[key]) { holes.insert(lastPos[key]); }
+            } else if (lastPos[key]) {
+                lastUse.add(lastPos[key], -1);
+            }
+            lastUse.add(now, 1);
+            lastPos[key] = now;
+        }
+    }
+    // faults(n) = cold misses + references whose (scaled) distance exceeds n
+    double scale = samplingRate >= 1.0 ? 1.0 : 1.0 / samplingRate;
+    // SHARDS-adj: the gap between the expected and the actual number of sampled references is credited to the
+    // smallest distance, which removes most of the bias of sampling few hot pages
+    double adjustment = samplingRate >= 1.0 ? 0.0 : references * samplingRate - sampledReferences;
+    printf("MRC REFERENCES=%ld SAMPLED=%ld RATE=%g\n", references, sampledReferences, samplingRate);
+    for (int frames: frameCounts) {
+        double faults = coldMisses;
+        for (size_t d = 1; d < distanceCount.size(); d++) {
+            if (d * scale > frames) { faults += distanceCount[d] + (d == 1 ? adjustment : 0.0); }
+        }
+        faults = max(0.0, faults * scale);
+        printf("FRAMES=%d FAULTS=%.0f MISSRATIO=%.6f\n", frames, faults, references ? faults / references : 0.0);
     }
 }
 
 int main(int argc, char *argv[]) {
     int opt;
-    char algo = '\0';  // Selected paging algorithm
-    string options;  // Optional output options
+    SimOptions options;
+    string outputOptions;  // Optional output options
     string processFile, randFile;
-    while ((opt = getopt(argc, argv, "f:a:o:")) != -1) {
+    string sweepFrames, sweepAlgos;  // Sweep mode configurations
+    int jobs = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+    bool mrc = false;  // Miss-ratio curve mode
+    int benchRepeats = 0;  // Benchmark mode: runs of each pager, 0 for no benchmark
+    double samplingRate = 1.0;  // SHARDS sampling rate of the miss-ratio curve
+    string decodeFile;  // Binary event log to decode
+    string whatIfProfiles;  // Cost files to price the run under as well
+    string countsFile;  // Where to write the operation counts of the run
+    string repriceFile;  // Operation counts to price instead of simulating
+    string batchList, batchOutput;  // Batch mode: list of process files, and the directory of their outputs
+    RandomSource randomSource;
+    static struct option longOptions[] = {
+        {"sweep-frames", required_argument, nullptr, 'F'},
+        {"sweep-algos", required_argument, nullptr, 'A'},
+        {"jobs", required_argument, nullptr, 'j'},
+        {"mrc", no_argument, nullptr, 'M'},
+        {"shards", required_argument, nullptr, 'R'},
+        {"event-log", required_argument, nullptr, 'L'},
+        {"async-log", no_argument, nullptr, 'B'},
+        {"decode", required_argument, nullptr, 'D'},
+        {"seed", required_argument, nullptr, 'G'},
+        {"tlb", required_argument, nullptr, 'T'},
+        {"tlb-asid", no_argument, nullptr, 'I'},
+        {"readahead", required_argument, nullptr, 'H'},
+        {"pcp-batch", required_argument, nullptr, 'C'},
+        {"checkpoint", required_argument, nullptr, 'K'},
+        {"checkpoint-every", required_argument, nullptr, 'N'},
+        {"resume", no_argument, nullptr, 'U'},
+        {"writeback", required_argument, nullptr, 'W'},
+        {"dirty-watermark", required_argument, nullptr, 'Y'},
+        {"zswap", required_argument, nullptr, 'Z'},
+        {"numa", required_argument, nullptr, 'X'},
+        {"numa-migrate", required_argument, nullptr, 'V'},
+        {"load-control", required_argument, nullptr, 'J'},
+        {"bench", optional_argument, nullptr, 'E'},
+        {"generic-loop", no_argument, nullptr, 'Q'},
+        {"costs", required_argument, nullptr, 'S'},
+        {"what-if", required_argument, nullptr, 'b'},
+        {"record-counts", required_argument, nullptr, 'c'},
+        {"reprice", required_argument, nullptr, 'd'},
+        {"batch", required_argument, nullptr, 'e'},
+        {"batch-out", required_argument, nullptr, 'g'},
+        {"metrics", required_argument, nullptr, 'O'},
+        {"metrics-every", required_argument, nullptr, 'P'},
+        {nullptr, 0, nullptr, 0}
+    };
+    while ((opt = getopt_long(argc, argv, "f:a:o:t:j:", longOptions, nullptr)) != -1) {
         switch (opt) {
             case 'f':
-                numFrames = stoi(optarg);  // Option argument
+                options.numFrames = stoi(optarg);  // Option argument
                 break;
             case 'a':
-                algo = optarg[0];
+                options.algo = optarg[0];
+                break;
+            case 't':
+                options.tau = stoi(optarg);  // Working-set window of the working-set pager
+                if (options.tau < 0) {
+                    cout << "TAU must be non-negative" << endl;
+                    return 1;
+                }
                 break;
             case 'o':
-                options = optarg;  
-                for (char& c: options) {
+                outputOptions = optarg;  
+                for (char& c: outputOptions) {
                     switch (c) {
                         case 'O':
-                            O_flag = true;
+                            options.O_flag = true;
                             break;
                         case 'P':
-                            P_flag = true;
+                            options.P_flag = true;
                             break;
                         case 'F':
-                            F_flag = true;
+                            options.F_flag = true;
                             break;
                         case 'S':
-                            S_flag = true;
+                            options.S_flag = true;
                             break;
                         default:
                             cout << "Invalid option character: " << c << endl;
@@ -641,10 +3782,218 @@ int main(int argc, char *argv[]) {
                     }
                 }
                 break;
+            case 'F':
+                sweepFrames = optarg;
+                break;
+            case 'A':
+                sweepAlgos = optarg;
+                break;
+            case 'j':
+                jobs = max(1, stoi(optarg));
+                break;
+            case 'M':
+                mrc = true;
+                break;
+            case 'R':
+                samplingRate = stod(optarg);
+                if (samplingRate <= 0.0 || samplingRate > 1.0) {
+                    cout << "The sampling rate must be in (0, 1]" << endl;
+                    return 1;
+                }
+                break;
+            case 'L':
+                options.eventLog = optarg;
+                break;
+            case 'B':
+                options.asyncLog = true;
+                break;
+            case 'D':
+                decodeFile = optarg;
+                break;
+            case 'T': {
+                // ENTRIES[:WAYS], fully associative without WAYS
+                string spec = optarg;
+                size_t colon = spec.find(':');
+                options.tlbEntries = stoi(spec.substr(0, colon));
+                options.tlbWays = colon == string::npos ? options.tlbEntries : stoi(spec.substr(colon + 1));
+                if (options.tlbEntries <= 0 || options.tlbWays <= 0 || options.tlbEntries % options.tlbWays != 0) {
+                    cout << "The TLB size must be a positive multiple of its associativity" << endl;
+                    return 1;
+                }
+                break;
+            }
+            case 'I':
+                options.tlbAsid = true;
+                break;
+            case 'H':
+                options.readahead = stoi(optarg);
+                if (options.readahead < 0 || options.readahead >= pageTableSize) {
+                    cout << "The readahead window must be between 0 and " << pageTableSize - 1 << " pages" << endl;
+                    return 1;
+                }
+                break;
+            case 'C':
+                options.pcpBatch = stoi(optarg);
+                if (options.pcpBatch < 1) {
+                    cout << "The per-CPU batch must be at least one frame" << endl;
+                    return 1;
+                }
+                break;
+            case 'K':
+                options.checkpoint = optarg;
+                break;
+            case 'N':
+                options.checkpointEvery = stol(optarg);
+                if (options.checkpointEvery < 1) {
+                    cout << "Checkpoints must be at least one instruction apart" << endl;
+                    return 1;
+                }
+                break;
+            case 'U':
+                options.resume = true;
+                break;
+            case 'W': {
+                // PAGES[:PERIOD]
+                string spec = optarg;
+                size_t colon = spec.find(':');
+                options.writebackPages = stoi(spec.substr(0, colon));
+                if (colon != string::npos) { options.writebackPeriod = stoi(spec.substr(colon + 1)); }
+                if (options.writebackPages < 1 || options.writebackPeriod < 1) {
+                    cout << "The writeback rate must be at least one page per period of at least one instruction" << endl;
+                    return 1;
+                }
+                break;
+            }
+            case 'Z': {
+                // PERCENT[:RATIO]
+                string spec = optarg;
+                size_t colon = spec.find(':');
+                options.zswapPercent = stoi(spec.substr(0, colon));
+                if (colon != string::npos) { options.zswapRatio = stod(spec.substr(colon + 1)); }
+                if (options.zswapPercent < 1 || options.zswapPercent > 90 || options.zswapRatio < 1.0) {
+                    cout << "The compressed pool must take 1-90% of the frames with a ratio of at least 1" << endl;
+                    return 1;
+                }
+                break;
+            }
+            case 'X': {
+                // NODES[:local|interleave|preferred=NODE]
+                string spec = optarg;
+                size_t colon = spec.find(':');
+                options.numaNodes = stoi(spec.substr(0, colon));
+                string policy = colon == string::npos ? "local" : spec.substr(colon + 1);
+                if (policy.compare(0, 10, "preferred=") == 0) {
+                    options.numaPolicy = 'p';
+                    options.numaPreferred = stoi(policy.substr(10));
+                } else if (policy == "interleave" || policy == "local") {
+                    options.numaPolicy = policy[0];
+                } else {
+                    cout << "Unknown NUMA policy " << policy << endl;
+                    return 1;
+                }
+                if (options.numaNodes < 1 || options.numaPreferred < 0 || options.numaPreferred >= options.numaNodes) {
+                    cout << "Invalid NUMA node" << endl;
+                    return 1;
+                }
+                break;
+            }
+            case 'J': {
+                // WINDOW[:RATE]
+                string spec = optarg;
+                size_t colon = spec.find(':');
+                options.loadWindow = stoi(spec.substr(0, colon));
+                if (colon != string::npos) { options.thrashRate = stoi(spec.substr(colon + 1)); }
+                if (options.loadWindow < 1 || options.thrashRate < 1 || options.thrashRate > 100) {
+                    cout << "The load-control window must be at least one instruction and the fault rate 1-100%" << endl;
+                    return 1;
+                }
+                break;
+            }
+            case 'V':
+                options.numaMigrate = stoi(optarg);
+                if (options.numaMigrate < 0) {
+                    cout << "The migration threshold must be non-negative" << endl;
+                    return 1;
+                }
+                break;
+            case 'Y':
+                options.dirtyWatermark = stoi(optarg);
+                if (options.dirtyWatermark < 0 || options.dirtyWatermark > 100) {
+                    cout << "The dirty watermark must be a percentage" << endl;
+                    return 1;
+                }
+                break;
+            case 'O':
+                options.metrics = optarg;
+                break;
+            case 'P':
+                options.metricsEvery = stol(optarg);
+                if (options.metricsEvery < 1) {
+                    cout << "The metrics period must be at least one instruction" << endl;
+                    return 1;
+                }
+                break;
+            case 'S':
+                options.costs = load_cost_file(optarg, InstrCost());
+                break;
+            case 'b':
+                whatIfProfiles = optarg;
+                break;
+            case 'c':
+                countsFile = optarg;
+                break;
+            case 'd':
+                repriceFile = optarg;
+                break;
+            case 'e':
+                batchList = optarg;
+                break;
+            case 'g':
+                batchOutput = optarg;
+                break;
+            case 'Q':
+                options.genericLoop = true;
+                break;
+            case 'E':
+                benchRepeats = optarg ? stoi(optarg) : 3;
+                if (benchRepeats < 1) {
+                    cout << "The benchmark needs at least one run per pager" << endl;
+                    return 1;
+                }
+                break;
+            case 'G':
+                randomSource.seeded = true;
+                randomSource.seed = stoull(optarg);
+                break;
             default:
                 return 1;
         }
     }
+    if (!decodeFile.empty()) {
+        return decode_event_log(decodeFile);
+    }
+    if (!repriceFile.empty()) {  // Price recorded counts: under --costs, and under every what-if profile
+        InstrCost counts = load_cost_file(repriceFile, zero_counts());
+        printf("TOTALCOST %llu\n", price(counts, options.costs));
+        if (!whatIfProfiles.empty()) { print_what_if(counts, whatIfProfiles); }
+        return 0;
+    }
+    if (!batchList.empty()) {  // The only argument is the rfile, shared by all traces
+        if (!options.checkpoint.empty() || !options.metrics.empty() || !options.eventLog.empty()) {
+            cout << "Checkpoints, metrics and event logs are only supported for single runs" << endl;
+            return 1;
+        }
+        if (mrc || benchRepeats > 0 || !sweepFrames.empty() || !sweepAlgos.empty()) {
+            cout << "Batch mode replays each trace with a single configuration" << endl;
+            return 1;
+        }
+        if (optind < argc) { randFile = argv[optind]; }
+        if (!randomSource.seeded || !randFile.empty()) {
+            randomSource.values = loadRandNumbers(randFile);
+        }
+        run_batch(options, randomSource, batchList, batchOutput, jobs);
+        return 0;
+    }
     // infile, rfile after the processing options (Process remaining arguments that are not options)
     if (optind < argc) {
         processFile = argv[optind++];
@@ -652,120 +4001,54 @@ int main(int argc, char *argv[]) {
             randFile = argv[optind];
         }
     }
-    // Initialize freeFrames and frameTable
-    create_frames(numFrames);
-    // Initialize the pager (Default: FIFO)
-    pager = new FIFO(frameTable);
-    if (algo == 'f') { pager = new FIFO(frameTable); }
-    if (algo == 'r') { pager = new Random(frameTable); }
-    if (algo == 'c') { pager = new Clock(frameTable); }
-    if (algo == 'e') { pager = new NRU(frameTable); }
-    if (algo == 'a') { pager = new Aging(frameTable); }
-    if (algo == 'w') { pager = new WorkingSet(frameTable); }
-
-    // First read random file
-    randvals = loadRandNumbers(randFile);
-    // Read process file
-    ifstream processFileStream(processFile);
-    string line;
-    // Skip initial comment lines: continue looping until finding a line that is not empty and does not start with '#'
-    while (getline(processFileStream, line) && (line.empty() || line[0] == '#'));
-    // This line contains the number of processes
-    int processNum = stoi(line);
-    // Process each process
-    for (int p = 0; p < processNum; p++) {
-        while (getline(processFileStream, line) && (line.empty() || line[0] == '#'));
-        // # of VMAs in the proces
-        currVmaNum = stoi(line);  // Read current process's VMA count and store it in "line"
-        // First initialize a process
-        Process* currP = new Process(p, currVmaNum);
-        // Process VMAs in each process
-        for (int v = 0; v < currVmaNum; v++) {
-            getline(processFileStream, line);  // Read each line and store it in "line"
-            istringstream iss(line);  // iss: treat a string object like a stream, so can extract values from line
-            int start_vpage, end_vpage;
-            bool write_protected, file_mapped;
-            if (iss >> start_vpage >> end_vpage >> write_protected >> file_mapped) {
-                Vma currVma = Vma(start_vpage, end_vpage, write_protected, file_mapped);
-                currP->vmaTable.push_back(currVma);
-            }
-        }
-        // Add process to the process table
-        processTable.push_back(currP);
+    // First read random file (not needed with a seeded PRNG), then the process file
+    if (!randomSource.seeded || !randFile.empty()) {
+        randomSource.values = loadRandNumbers(randFile);
     }
-    // Read and store all instructions into a queue
-    while (getline(processFileStream, line)) {
-        if (line.empty() || line[0] == '#' || line.find("####") != string::npos) {
-            continue;
-        }
-        istringstream iss(line);
-        char instrType;
-        int instrValue;
-        if (iss >> instrType >> instrValue) {
-            Instructions currInstr(instrType, instrValue);
-            instructions.push(currInstr);
-        }
+    Trace trace = load_trace(processFile);
+    if (options.resume && options.checkpoint.empty()) {
+        cout << "--resume needs the --checkpoint file to resume from" << endl;
+        return 1;
+    }
+    if (!options.checkpoint.empty() && (mrc || benchRepeats > 0 || !sweepFrames.empty() || !sweepAlgos.empty())) {
+        cout << "Checkpoints are only supported for single runs" << endl;
+        return 1;
+    }
+    if (!options.metrics.empty() && (mrc || benchRepeats > 0 || !sweepFrames.empty() || !sweepAlgos.empty())) {
+        cout << "Metrics are only supported for single runs" << endl;
+        return 1;
     }
-    inst_count = instructions.size();
 
-    // Simulation structure
-    char operation;
-    int vpage;
-    while (get_next_instruction(operation, vpage)) {
-        if (O_flag) { cout << idx << ": ==> " << operation << " " << vpage << endl; }
-        idx++;
-        instrCounter++;  // Increase instrCounter by 1 for the daemon function
-        currentTime++;  // Increase currentTime by 1 
-        switch (operation) {
-            case 'c':
-                currProc = processTable[vpage];  
-                ctx_switches++;
-                // currPageTable = currProc->pageTable;
-                break;
-            case 'e':
-                currProc = processTable[vpage];  // exiting process
-                currProc->exit = true;
-                process_exits++;
-                totalExit++;
-                exit_handler(currProc);
-                break;
-            default:
-                Pte_t* pte = &currProc->pageTable[vpage];  // Get the correct page from pageTable in process
-                vector<Vma>* currVmaTable = &currProc->vmaTable;
-                // updateTimeLastUsed(frameTable);  // Update the time_last_used variable for each frame (for working-set pager)
-                if (!pte->PRESENT) {  // Handle page fault
-                    pagefault_handler(pte, currVmaTable, vpage);  // Handle page fault error 
-                    if (segv) {  // If it's not valid, print error message and continue to the next instruction
-                        segv = false;
-                        if (O_flag) { cout << " SEGV" << endl; }
-                        currProc->stats->segv++;  // Update pstats
-                        if (operation == 'r') { totalRead++; }  // Also update totalRead and totalWrite
-                        if (operation == 'w') { totalWrite++; }
-                        continue;  // Print an SEGV error message and continue to the next instruction
-                    }
-                    // Frame_t* newframe = get_frame();  // The page is valid (belongs to a VMA), so assign a frame to it
-                } 
-                if (operation == 'r') {
-                    pte->REFERENCED = 1;
-                    totalRead++;
-                } else {  // operation == 'w'
-                    pte->REFERENCED = 1;
-                    if (pte->WRITE_PROTECT) {
-                        if (O_flag) { cout << " SEGPROT" << endl; }
-                        currProc->stats->segprot++;  // Update pstats
-                    } else {
-                        pte->MODIFIED = 1;  // The page is modified (written to)
-                    }
-                    totalWrite++;
-                }
+    if (mrc) {
+        if (trace.numCpus > 1 || trace.hasFork) {
+            cout << "The miss-ratio curve does not support multi-CPU or forking traces" << endl;
+            return 1;
         }
+        vector<int> frameCounts = parse_frame_list(sweepFrames.empty() ? "1-" + to_string(maxFrames) : sweepFrames);
+        run_mrc(trace, frameCounts, samplingRate);
+        return 0;
     }
-    if (P_flag) { pageTable_printer(processTable); }
-    if (F_flag) { frameTable_printer(frameTable); }
-    if (S_flag) {
-        for (vector<Process*>::const_iterator process = processTable.begin(); process != processTable.end(); ++process) {
-            summary_printer(**process);  // Dereference iterator to get Process* and then dereference again to pass Process to summary_printer
+    if (benchRepeats > 0) {  // Every pager unless --sweep-algos picks some
+        run_bench(options, trace, randomSource, sweepAlgos.empty() ? "frceawxplu" : sweepAlgos, benchRepeats);
+        return 0;
+    }
+    if (!sweepFrames.empty() || !sweepAlgos.empty()) {
+        vector<int> frameCounts = sweepFrames.empty() ? vector<int>(1, options.numFrames) : parse_frame_list(sweepFrames);
+        string algos = sweepAlgos.empty() ? string(1, options.algo ? options.algo : 'f') : sweepAlgos;
+        for (int frames: frameCounts) {
+            if (frames < 1 || frames > maxFrames) {
+                cout << "Frame counts must be between 1 and " << maxFrames << endl;
+                return 1;
+            }
         }
+        run_sweep(options, trace, randomSource, frameCounts, algos, jobs);
+        return 0;
     }
+
+    Simulation sim(options, trace, randomSource);
+    sim.run();
+    sim.print_results();
+    if (!countsFile.empty()) { write_counts(countsFile, sim.operation_counts()); }
+    if (!whatIfProfiles.empty()) { print_what_if(sim.operation_counts(), whatIfProfiles); }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <getopt.h>
+#include <string>
+#include <random>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+// Synthetic trace generator: writes a process file in the format read by mmu_ (the process/VMA specifications
+// followed by the instructions) to stdout. Every process references the pages of its address space following one
+// access pattern; the processes take turns in quanta of references.
+
+constexpr int pageTableSize = 64;  // Virtual pages of a process (as in mmu_)
+
+struct GenOptions {
+    string pattern = "uniform";  // uniform, zipf, loop or phase
+    long refs = 10000;  // References over all processes
+    int processes = 1;
+    uint64_t seed = 1;
+    int writePercent = 30;  // Percentage of the references that are writes
+    double zipfSkew = 1.0;  // Exponent of the Zipfian distribution
+    int loopPages = 48;  // Pages of a looping scan (larger than memory for a thrashing scan)
+    int hotPages = 8;  // Pages of the working set of a phase
+    long phaseLength = 1000;  // References of a process between phase changes
+    int quantum = 100;  // References of a process before the next one is switched to
+    bool exits = true;  // End every process with an exit
+};
+
+// Access pattern of one process over the pages [0, pageTableSize)
+class PageStream {
+    private:
+        const GenOptions& opts;
+        mt19937_64& rng;
+        vector<int> ranks;  // Zipf: page of each popularity rank
+        vector<double> cumulative;  // Zipf: cumulative probability of the ranks
+        int loopStart = 0;  // Loop: first page of the scan
+        int position = 0;  // Loop: next page of the scan
+        int hotStart = 0;  // Phase: first page of the current working set
+        long referenced = 0;
+    public:
+        PageStream(const GenOptions& opts, mt19937_64& rng): opts(opts), rng(rng) {
+            if (opts.pattern == "zipf") {
+                for (int p = 0; p < pageTableSize; p++) { ranks.push_back(p); }
+                shuffle(ranks.begin(), ranks.end(), rng);  // The hot pages are spread over the address space
+                double sum = 0;
+                for (int r = 1; r <= pageTableSize; r++) {
+                    sum += 1.0 / pow(r, opts.zipfSkew);
+                    cumulative.push_back(sum);
+                }
+                for (double& c: cumulative) { c /= sum; }
+            } else if (opts.pattern == "loop") {
+                loopStart = uniform_int_distribution<int>(0, pageTableSize - opts.loopPages)(rng);
+            } else if (opts.pattern == "phase") {
+                hotStart = uniform_int_distribution<int>(0, pageTableSize - opts.hotPages)(rng);
+            }
+        }
+        int next_page() {
+            referenced++;
+            if (opts.pattern == "zipf") {
+                double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+                size_t rank = lower_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin();
+                return ranks[min(rank, ranks.size() - 1)];
+            }
+            if (opts.pattern == "loop") {
+                int page = loopStart + position;
+                position = (position + 1) % opts.loopPages;
+                return page;
+            }
+            if (opts.pattern == "phase") {
+                if (referenced % opts.phaseLength == 0) {  // Move the working set somewhere else
+                    hotStart = uniform_int_distribution<int>(0, pageTableSize - opts.hotPages)(rng);
+                }
+                return hotStart + uniform_int_distribution<int>(0, opts.hotPages - 1)(rng);
+            }
+            return uniform_int_distribution<int>(0, pageTableSize - 1)(rng);
+        }
+};
+
+void print_usage() {
+    cout << "Usage: tracegen [-p uniform|zipf|loop|phase] [-n REFS] [-P PROCESSES] [-s SEED] [-w WRITE%]\n"
+            "                [--skew=S] [--loop=PAGES] [--hot=PAGES] [--phase=REFS] [--quantum=REFS] [--no-exit]" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    GenOptions opts;
+    static struct option longOptions[] = {
+        {"skew", required_argument, nullptr, 'k'},
+        {"loop", required_argument, nullptr, 'l'},
+        {"hot", required_argument, nullptr, 'h'},
+        {"phase", required_argument, nullptr, 'g'},
+        {"quantum", required_argument, nullptr, 'q'},
+        {"no-exit", no_argument, nullptr, 'x'},
+        {nullptr, 0, nullptr, 0}
+    };
+    while ((opt = getopt_long(argc, argv, "p:n:P:s:w:", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'p':
+                opts.pattern = optarg;
+                break;
+            case 'n':
+                opts.refs = stol(optarg);
+                break;
+            case 'P':
+                opts.processes = stoi(optarg);
+                break;
+            case 's':
+                opts.seed = stoull(optarg);
+                break;
+            case 'w':
+                opts.writePercent = stoi(optarg);
+                break;
+            case 'k':
+                opts.zipfSkew = stod(optarg);
+                break;
+            case 'l':
+                opts.loopPages = stoi(optarg);
+                break;
+            case 'h':
+                opts.hotPages = stoi(optarg);
+                break;
+            case 'g':
+                opts.phaseLength = stol(optarg);
+                break;
+            case 'q':
+                opts.quantum = stoi(optarg);
+                break;
+            case 'x':
+                opts.exits = false;
+                break;
+            default:
+                print_usage();
+                return 1;
+        }
+    }
+    if (opts.pattern != "uniform" && opts.pattern != "zipf" && opts.pattern != "loop" && opts.pattern != "phase") {
+        cout << "Unknown pattern " << opts.pattern << endl;
+        return 1;
+    }
+    if (opts.refs < 0 || opts.processes < 1 || opts.writePercent < 0 || opts.writePercent > 100 || opts.quantum < 1
+        || opts.zipfSkew < 0 || opts.phaseLength < 1 || opts.loopPages < 1 || opts.loopPages > pageTableSize
+        || opts.hotPages < 1 || opts.hotPages > pageTableSize) {
+        print_usage();
+        return 1;
+    }
+
+    mt19937_64 rng(opts.seed);
+    // Every process maps its whole address space: anonymous memory in the lower three quarters and a file in the
+    // upper quarter, so the pattern decides the pages used
+    printf("# generated by tracegen: pattern %s, %ld refs, %d processes\n", opts.pattern.c_str(), opts.refs, opts.processes);
+    printf("# seed %llu\n", (unsigned long long)opts.seed);
+    printf("%d\n", opts.processes);
+    for (int p = 0; p < opts.processes; p++) {
+        printf("#### process %d\n#\n2\n", p);
+        printf("0 %d 0 0\n", pageTableSize * 3 / 4 - 1);
+        printf("%d %d 0 1\n", pageTableSize * 3 / 4, pageTableSize - 1);
+    }
+    printf("#### instruction simulation ######\n");
+    vector<PageStream> streams;
+    for (int p = 0; p < opts.processes; p++) { streams.push_back(PageStream(opts, rng)); }
+    uniform_int_distribution<int> percent(0, 99);
+    int curr = -1;
+    for (long i = 0; i < opts.refs; i++) {
+        if (i % opts.quantum == 0) {  // Round robin over the processes
+            int next = (i / opts.quantum) % opts.processes;
+            if (next != curr) {
+                curr = next;
+                printf("c %d\n", curr);
+            }
+        }
+        printf("%c %d\n", percent(rng) < opts.writePercent ? 'w' : 'r', streams[curr].next_page());
+    }
+    if (opts.exits) {
+        for (int p = 0; p < opts.processes; p++) { printf("e %d\n", p); }
+    }
+    return 0;
+}